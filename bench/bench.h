@@ -0,0 +1,104 @@
+//===-- bench/bench.h -----------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+
+#ifndef _LOOM_BENCH_H_
+#define _LOOM_BENCH_H_
+
+// Benchmarks are standalone programs built against a release build of the
+// library, compiled as C++ just like it. From the root of the repository:
+//
+//   c++ -O2 -Iinclude -DLOOM_CONFIGURATION=LOOM_CONFIGURATION_RELEASE \
+//       -DLOOM_LINKAGE=LOOM_LINKAGE_STATIC -x c++ bench/steal.c \
+//       -Lpath/to/lib -lloom -lpthread -o steal
+//
+// Tunables like `LOOM_STEAL_LIMIT` are compared by rebuilding the library
+// with them defined. Those in `loom.h` must be defined for the benchmark too.
+//
+// Each takes the number of workers to bring up as its first argument, which
+// defaults to one less than the number of cores.
+
+#include "loom.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+/// Returns a monotonic timestamp, in nanoseconds.
+static loom_uint64_t bench_now(void) {
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (loom_uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (loom_uint64_t)now.tv_sec * 1000000000ull + (loom_uint64_t)now.tv_nsec;
+#endif
+}
+
+/// Initializes Loom for benchmarking, with workers as given on the command
+/// line.
+static void bench_initialize(int argc, char **argv) {
+  loom_options_t options;
+  memset((void *)&options, 0, sizeof(options));
+
+  options.workers = (argc > 1) ? atoi(argv[1]) : -1;
+  options.main_thread_does_work = true;
+
+  // Sized so pools and queues don't grow while timing.
+  options.tasks = 65536;
+  options.permits = 65536;
+  options.queue = 8192;
+  options.injection = 4096;
+
+  // Spin briefly between bursts, so we measure scheduling rather than waking.
+  options.idle.spin = 100;
+  options.idle.yield = 100;
+  options.idle.adaptive = false;
+
+  loom_initialize(&options);
+}
+
+typedef void (*bench_fn)(void *data);
+
+/// Runs @fn @repeats times, returning the fastest run in nanoseconds.
+///
+/// \details The first run warms pools, queues and caches, so isn't counted.
+///
+static double bench_best_of(unsigned repeats, bench_fn fn, void *data) {
+  fn(data);
+
+  double best = 1e300;
+
+  for (unsigned repeat = 0; repeat < repeats; ++repeat) {
+    const loom_uint64_t started = bench_now();
+    fn(data);
+    const double elapsed = (double)(bench_now() - started);
+
+    if (elapsed < best)
+      best = elapsed;
+  }
+
+  return best;
+}
+
+/// Defeats optimization of otherwise unused results.
+static volatile loom_uint64_t bench_sink;
+
+#endif // _LOOM_BENCH_H_
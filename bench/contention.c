@@ -0,0 +1,72 @@
+//===-- bench/contention.c ------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+
+// Measures scheduling under contention, with tasks that spawn children so
+// every worker pushes, pops and steals at the same time.
+//
+// False sharing only shows with workers on separate cores, so run this with
+// at least as many cores as workers.
+
+#include "bench.h"
+
+#define BENCH_DEPTH 13
+#define BENCH_REPEATS 32
+
+// Each task spawns two more until reaching the given depth.
+#define BENCH_TASKS ((1u << BENCH_DEPTH) - 1)
+
+static volatile long completed;
+
+static void completes(void) {
+#if LOOM_COMPILER == LOOM_COMPILER_MSVC
+  _InterlockedIncrement(&completed);
+#else
+  __sync_fetch_and_add(&completed, 1);
+#endif
+}
+
+static void spawn(void *data) {
+  const loom_size_t depth = (loom_size_t)data;
+
+  if (depth + 1 < BENCH_DEPTH) {
+    loom_handle_t children[2];
+
+    children[0] = loom_describe(&spawn, (void *)(depth + 1), 0);
+    children[1] = loom_describe(&spawn, (void *)(depth + 1), 0);
+
+    loom_kick_n(2, &children[0]);
+  }
+
+  completes();
+}
+
+static void tree(void *unused) {
+  completed = 0;
+
+  loom_kick(loom_describe(&spawn, (void *)0, 0));
+
+  while (completed != BENCH_TASKS)
+    loom_do_some_work();
+}
+
+int main(int argc, char **argv) {
+  bench_initialize(argc, argv);
+
+  const double elapsed = bench_best_of(BENCH_REPEATS, &tree, NULL);
+
+  printf("contention: %u tasks in %.0f us (%.1f ns/task)\n",
+         BENCH_TASKS, elapsed / 1e3, elapsed / BENCH_TASKS);
+
+  loom_shutdown();
+
+  return EXIT_SUCCESS;
+}
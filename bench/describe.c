@@ -0,0 +1,120 @@
+//===-- bench/describe.c --------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+
+// Measures the cost of describing tasks: fanning out past the embedded
+// permits, copying payloads into tasks rather than allocating them, and
+// describing tasks in bulk.
+//
+// Compare `LOOM_EMBEDDED_PERMITS`, `LOOM_INLINE_PAYLOAD` and
+// `LOOM_MAGAZINE_BATCH` by rebuilding the library with them defined. The
+// first two must be defined for the benchmark too.
+
+#include "bench.h"
+
+#define BENCH_REPEATS 32
+
+// Number of graphs or tasks described per run.
+#define BENCH_GRAPHS 256
+#define BENCH_TASKS 4096
+
+// Widest fan-out measured.
+#define BENCH_FAN_OUT 8
+
+static volatile loom_uint32_t checksum;
+
+static void nothing(void *data) {
+}
+
+static void touch(void *data) {
+  checksum += *(const loom_uint8_t *)data;
+}
+
+static void touch_and_free(void *data) {
+  checksum += *(const loom_uint8_t *)data;
+  free(data);
+}
+
+static unsigned fan_out;
+
+// A task that permits `fan_out` others.
+static void fans(void *unused) {
+  loom_handle_t handles[1 + BENCH_FAN_OUT];
+
+  for (unsigned graph = 0; graph < BENCH_GRAPHS; ++graph) {
+    handles[0] = loom_describe(&nothing, NULL, 0);
+
+    for (unsigned i = 1; i <= fan_out; ++i) {
+      handles[i] = loom_describe(&nothing, NULL, 0);
+      loom_permits(handles[0], handles[i]);
+    }
+
+    loom_kick_and_do_work_while_waiting_n(1 + fan_out, &handles[0]);
+  }
+}
+
+static loom_size_t size_of_payload;
+static loom_bool_t inline_payload;
+
+static loom_handle_t handles[BENCH_TASKS];
+
+// Tasks that each read a payload of `size_of_payload` bytes.
+static void payloads(void *unused) {
+  loom_uint8_t payload[LOOM_INLINE_PAYLOAD];
+  memset((void *)&payload[0], 1, sizeof(payload));
+
+  for (unsigned i = 0; i < BENCH_TASKS; ++i) {
+    if (inline_payload) {
+      handles[i] = loom_describe_with_payload(&touch, &payload[0], size_of_payload, 0);
+    } else {
+      void *copy = malloc(size_of_payload);
+      memcpy(copy, (const void *)&payload[0], size_of_payload);
+      handles[i] = loom_describe(&touch_and_free, copy, 0);
+    }
+  }
+
+  loom_kick_and_do_work_while_waiting_n(BENCH_TASKS, &handles[0]);
+}
+
+// Tasks described and kicked in bulk.
+static void bulk(void *unused) {
+  loom_describe_n(BENCH_TASKS, &nothing, NULL, 0, &handles[0]);
+  loom_kick_and_do_work_while_waiting_n(BENCH_TASKS, &handles[0]);
+}
+
+int main(int argc, char **argv) {
+  bench_initialize(argc, argv);
+
+  printf("describe: %u embedded permits, %u byte inline payloads\n",
+         (unsigned)LOOM_EMBEDDED_PERMITS, (unsigned)LOOM_INLINE_PAYLOAD);
+
+  for (fan_out = 0; fan_out <= BENCH_FAN_OUT; ++fan_out) {
+    const double elapsed = bench_best_of(BENCH_REPEATS, &fans, NULL);
+    printf("  fan-out of %u: %.1f ns/graph\n", fan_out, elapsed / BENCH_GRAPHS);
+  }
+
+  for (size_of_payload = 16; size_of_payload <= LOOM_INLINE_PAYLOAD; size_of_payload *= 2) {
+    inline_payload = true;
+    const double copied = bench_best_of(BENCH_REPEATS, &payloads, NULL);
+    inline_payload = false;
+    const double allocated = bench_best_of(BENCH_REPEATS, &payloads, NULL);
+
+    printf("  %u byte payload: %.1f ns/task inline, %.1f ns/task allocated\n",
+           (unsigned)size_of_payload, copied / BENCH_TASKS, allocated / BENCH_TASKS);
+  }
+
+  const double elapsed = bench_best_of(BENCH_REPEATS, &bulk, NULL);
+  printf("  in bulk: %.1f ns/task\n", elapsed / BENCH_TASKS);
+
+  loom_shutdown();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+//===-- bench/reduce.c ----------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+
+// Measures `loom_parallel_reduce` and `loom_parallel_scan` against serial
+// loops over the same data, for large ranges and for ranges small enough that
+// setting up partial results dominates.
+
+#include "bench.h"
+
+#define BENCH_REPEATS 16
+
+#define BENCH_LARGE (1u << 22)
+#define BENCH_SMALL 256
+
+#define BENCH_GRAIN 4096
+#define BENCH_SMALL_GRAIN 64
+
+static loom_uint64_t *input;
+static loom_uint64_t *output;
+
+static void sum(loom_size_t begin, loom_size_t end, void *partial, void *data) {
+  loom_uint64_t total = *(loom_uint64_t *)partial;
+
+  for (loom_size_t i = begin; i < end; ++i)
+    total += input[i];
+
+  *(loom_uint64_t *)partial = total;
+}
+
+static void add(void *into, const void *from, void *data) {
+  *(loom_uint64_t *)into += *(const loom_uint64_t *)from;
+}
+
+static void prefix_sum(loom_size_t begin, loom_size_t end, const void *prefix, void *data) {
+  loom_uint64_t total = *(const loom_uint64_t *)prefix;
+
+  for (loom_size_t i = begin; i < end; ++i)
+    output[i] = (total += input[i]);
+}
+
+static const loom_uint64_t zero = 0;
+
+static loom_size_t n;
+static loom_size_t grain;
+
+static void serial_reduce(void *unused) {
+  loom_uint64_t total = 0;
+  sum(0, n, (void *)&total, NULL);
+  bench_sink = total;
+}
+
+static void parallel_reduce(void *unused) {
+  loom_uint64_t total;
+  loom_parallel_reduce(0, n, grain, sizeof(total), &zero, &sum, &add, NULL, &total);
+  bench_sink = total;
+}
+
+static void serial_scan(void *unused) {
+  prefix_sum(0, n, (const void *)&zero, NULL);
+}
+
+static void parallel_scan(void *unused) {
+  loom_parallel_scan(0, n, grain, sizeof(loom_uint64_t), &zero, &sum, &add, &prefix_sum, NULL);
+}
+
+static void compare(const char *name, bench_fn serial, bench_fn parallel) {
+  const double baseline = bench_best_of(BENCH_REPEATS, serial, NULL);
+  const double elapsed = bench_best_of(BENCH_REPEATS, parallel, NULL);
+
+  printf("  %s of %u: %.2f us serial, %.2f us parallel\n",
+         name, (unsigned)n, baseline / 1e3, elapsed / 1e3);
+}
+
+int main(int argc, char **argv) {
+  bench_initialize(argc, argv);
+
+  input = (loom_uint64_t *)malloc(BENCH_LARGE * sizeof(loom_uint64_t));
+  output = (loom_uint64_t *)malloc(BENCH_LARGE * sizeof(loom_uint64_t));
+
+  for (loom_size_t i = 0; i < BENCH_LARGE; ++i)
+    input[i] = i;
+
+  printf("reduce:\n");
+
+  n = BENCH_LARGE;
+  grain = BENCH_GRAIN;
+
+  compare("reduce", &serial_reduce, &parallel_reduce);
+  compare("scan", &serial_scan, &parallel_scan);
+
+  n = BENCH_SMALL;
+  grain = BENCH_SMALL_GRAIN;
+
+  compare("reduce", &serial_reduce, &parallel_reduce);
+  compare("scan", &serial_scan, &parallel_scan);
+
+  free((void *)input);
+  free((void *)output);
+
+  loom_shutdown();
+
+  return EXIT_SUCCESS;
+}
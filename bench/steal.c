@@ -0,0 +1,54 @@
+//===-- bench/steal.c -----------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+
+// Measures the cost of distributing a flat batch of tiny tasks, kicked from
+// the main thread, to workers that have to steal them.
+//
+// Compare `LOOM_STEAL_LIMIT` by rebuilding the library with it defined.
+
+#include "bench.h"
+
+#define BENCH_TASKS 4096
+#define BENCH_REPEATS 64
+
+static loom_uint32_t work[BENCH_TASKS];
+static void *data[BENCH_TASKS];
+static loom_handle_t handles[BENCH_TASKS];
+
+static void tiny(void *data) {
+  loom_uint32_t *item = (loom_uint32_t *)data;
+
+  // Roughly a hundred nanoseconds.
+  for (unsigned i = 0; i < 64; ++i)
+    *item = *item * 1664525u + 1013904223u;
+}
+
+static void batch(void *unused) {
+  loom_describe_n(BENCH_TASKS, &tiny, &data[0], 0, &handles[0]);
+  loom_kick_and_do_work_while_waiting_n(BENCH_TASKS, &handles[0]);
+}
+
+int main(int argc, char **argv) {
+  bench_initialize(argc, argv);
+
+  for (unsigned i = 0; i < BENCH_TASKS; ++i)
+    data[i] = (void *)&work[i];
+
+  const double elapsed = bench_best_of(BENCH_REPEATS, &batch, NULL);
+
+  printf("steal: %u tasks in %.0f us (%.1f ns/task)\n",
+         BENCH_TASKS, elapsed / 1e3, elapsed / BENCH_TASKS);
+
+  loom_shutdown();
+
+  return EXIT_SUCCESS;
+}
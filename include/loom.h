@@ -30,17 +30,61 @@ typedef struct loom_task loom_task_t;
 
 typedef struct loom_handle loom_handle_t;
 
+typedef struct loom_counter loom_counter_t;
+
+typedef struct loom_arena loom_arena_t;
+
+typedef struct loom_graph loom_graph_t;
+
+typedef enum loom_io_op loom_io_op_t;
+typedef struct loom_io loom_io_t;
+
 /// Type of work.
 enum loom_kind_of_work {
   LOOM_WORK_NONE = 0,
   LOOM_WORK_CPU  = 1,
 
+  /// \brief Runs on a fiber, so can suspend while waiting.
+  ///
+  /// \details Fiber tasks that wait on a counter, or kick and wait on other
+  /// tasks, are suspended rather than nesting other work on top of them.
+  /// Their workers go on to schedule other tasks, and they're resumed once
+  /// what they're waiting on is done.
+  ///
+  LOOM_WORK_FIBER = 2,
+
+  /// \brief Reads, writes, or flushes a file without occupying a worker.
+  ///
+  /// \details I/O tasks are submitted to an io_uring that workers poll. Once
+  /// the operation completes, the task completes like any other, decrementing
+  /// its counter and releasing its permits.
+  ///
+  LOOM_WORK_IO = 3,
+
   // Force `loom_uint32_t` storage and alignment.
   __LOOM_KIND_OF_WORK_FORCE_STORAGE_AND_ALIGNMENT__ = 0x7ffffffful
 };
 
 typedef void (*loom_kernel_fn)(void *);
 
+typedef void (*loom_range_fn)(loom_size_t begin,
+                              loom_size_t end,
+                              void *data);
+
+typedef void (*loom_reduce_fn)(loom_size_t begin,
+                               loom_size_t end,
+                               void *partial,
+                               void *data);
+
+typedef void (*loom_combine_fn)(void *into,
+                                const void *from,
+                                void *data);
+
+typedef void (*loom_scan_fn)(loom_size_t begin,
+                             loom_size_t end,
+                             const void *prefix,
+                             void *data);
+
 /// A schedulable unit of work.
 struct loom_work {
   loom_kind_of_work_t kind;
@@ -50,9 +94,57 @@ struct loom_work {
       loom_kernel_fn kernel;
       void *data;
     } cpu;
+
+    struct {
+      loom_kernel_fn kernel;
+      void *data;
+    } fiber;
+
+    struct {
+      loom_io_t *request;
+    } io;
   };
 };
 
+/// Kind of I/O operation.
+enum loom_io_op {
+  LOOM_IO_READ  = 0,
+  LOOM_IO_WRITE = 1,
+  LOOM_IO_FSYNC = 2,
+
+  // Force `loom_uint32_t` storage and alignment.
+  __LOOM_IO_OP_FORCE_STORAGE_AND_ALIGNMENT__ = 0x7ffffffful
+};
+
+/// Describes an I/O operation.
+struct loom_io {
+  /// \copydoc loom_io_op_t
+  loom_uint32_t op;
+
+  /// \brief File descriptor to operate on.
+  ///
+  /// \note On Windows, a C runtime file descriptor, as returned by `_open`.
+  ///       Use `_open_osfhandle` to wrap a `HANDLE`.
+  ///
+  loom_int32_t fd;
+
+  /// Buffer to read into or write from. Ignored by `LOOM_IO_FSYNC`.
+  void *buffer;
+
+  /// Number of bytes to read or write. Ignored by `LOOM_IO_FSYNC`.
+  loom_size_t size;
+
+  /// Offset into the file to read from or write to.
+  loom_uint64_t offset;
+
+  /// \brief Where to store the result, if anywhere.
+  ///
+  /// \details Stores the number of bytes transferred, or a negated `errno`
+  /// on failure, prior to the task completing.
+  ///
+  loom_int64_t *result;
+};
+
 /// \brief Specifies a task that is permitted to run by another task.
 ///
 /// \details Permits are a simplified implementation of reverse dependencies,
@@ -88,39 +180,89 @@ struct loom_permit {
 
 /// Various flags that affects task behavior.
 enum loom_task_flags {
+  /// \brief Task is latency critical.
+  ///
+  /// \details Critical tasks are scheduled ahead of all other tasks, and are
+  /// stolen from other workers before any other work is performed.
+  ///
+  LOOM_TASK_CRITICAL = (1 << 0),
+
+  /// \brief Task should only be scheduled when there's nothing else to do.
+  ///
+  /// \note Tasks that are neither critical nor background are normal.
+  ///
+  LOOM_TASK_BACKGROUND = (1 << 1),
+
+  // Force `loom_uint32_t` storage and alignment.
+  __LOOM_TASK_FLAGS_FORCE_STORAGE_AND_ALIGNMENT__ = 0x7ffffffful
 };
 
-// TODO(mtwilliams): Optimize number of embedded permits.
+/// \def LOOM_EMBEDDED_PERMITS
+/// \brief Number of permits allocated along with each task.
+///
+/// \details Three fills the bookkeeping kept apart from each task to exactly
+/// one cache line on 64-bit targets, and covers the small fan-outs that make
+/// up most graphs.
+///
 #ifndef LOOM_EMBEDDED_PERMITS
-  #define LOOM_EMBEDDED_PERMITS 1
+  #define LOOM_EMBEDDED_PERMITS 3
 #endif
 
-/// A schedulable unit of work and its permits.
-struct loom_task {
-  /// Globally unique identifier.
-  loom_uint32_t id;
-
-  /// \copydoc loom_task_flags_t
-  loom_uint32_t flags;
+/// \def LOOM_INLINE_PAYLOAD
+/// \brief Maximum size of a payload that can be copied into a task.
+///
+/// \note Payloads follow the fields needed to dispatch a task, and fill the
+///       next cache line by default.
+///
+#ifndef LOOM_INLINE_PAYLOAD
+  #define LOOM_INLINE_PAYLOAD LOOM_CACHE_LINE
+#endif
 
+/// \brief A schedulable unit of work.
+///
+/// \details Everything needed to dispatch a task fits in its first cache
+/// line. Bookkeeping only needed by tasks that permit others, such as their
+/// embedded permits, is kept apart from tasks.
+///
+struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_task {
   /// Work to perform.
   loom_work_t work;
 
-  /// \brief Linked-list of tasks blocked by this task.
-  ///
-  /// \note The first few permits are allocated along with the task to improve
-  ///       data locality.
-  ///
-  loom_permit_t permits[LOOM_EMBEDDED_PERMITS];
+  /// Decremented after completion.
+  loom_counter_t *counter;
 
-  /// Number of tasks blocked by this task.
-  loom_uint32_t blocks;
+  /// Linked-list of tasks blocked by this task.
+  loom_permit_t *permits;
 
   /// Number of outstanding tasks blocking this task.
   loom_uint32_t blockers;
 
-  /// Decremented after completion.
-  loom_uint32_t *barrier;
+  /// \copydoc loom_task_flags_t
+  loom_uint32_t flags;
+
+  /// Globally unique identifier.
+  loom_uint32_t id;
+
+  /// Index into the task pool.
+  loom_uint32_t index;
+
+  /// Fiber a suspended task resumes on, if any.
+  void *fiber;
+
+  /// \brief Storage for small payloads.
+  ///
+  /// \details Payloads passed to `loom_describe_with_payload` are copied here
+  /// and handed to the kernel, sparing callers from allocating and retaining
+  /// them separately.
+  ///
+  union LOOM_ALIGNED(LOOM_CACHE_LINE) {
+    loom_uint8_t bytes[LOOM_INLINE_PAYLOAD];
+
+    // Ensure suitable alignment for any fundamental type.
+    loom_uint64_t __alignment__;
+    double __alignment_of_double__;
+    void *__alignment_of_pointer__;
+  } payload;
 };
 
 struct loom_handle {
@@ -135,6 +277,28 @@ struct loom_handle {
 
 extern const loom_handle_t LOOM_INVALID_HANDLE;
 
+/// \brief Counts outstanding tasks, so that threads can wait on them.
+///
+/// \details Counters are incremented when tasks are kicked with them, and
+/// decremented as each of those tasks is completed. Any number of tasks can be
+/// kicked with a counter, at any time, including from within other tasks. This
+/// lets tasks that fan out dynamically join without declaring permits up
+/// front.
+///
+/// \note Initialize with `LOOM_COUNTER_INITIALIZER`. Treat as opaque.
+///
+struct loom_counter {
+  loom_uint32_t value;
+  loom_uint32_t target;
+
+  // Task suspended waiting on the counter, if any.
+  void *waiting;
+};
+
+/// \def LOOM_COUNTER_INITIALIZER
+/// \brief Initializes a counter to zero.
+#define LOOM_COUNTER_INITIALIZER { 0, 0, NULL }
+
 typedef void (*loom_prologue_fn)(const loom_task_t *task,
                                  void *context);
 
@@ -161,6 +325,52 @@ typedef struct loom_epilogue {
   #endif
 #endif
 
+/// How to back task pools, permit pools, and work queues.
+enum loom_pages {
+  /// Regular pages.
+  LOOM_PAGES_DEFAULT = 0,
+
+  /// Advise the kernel to use huge pages, where it can.
+  LOOM_PAGES_TRANSPARENT_HUGE = 1,
+
+  /// Use explicitly reserved huge pages, falling back to transparent huge
+  /// pages if none are available.
+  LOOM_PAGES_HUGE = 2,
+
+  // Force `loom_uint32_t` storage and alignment.
+  __LOOM_PAGES_FORCE_STORAGE_AND_ALIGNMENT__ = 0x7ffffffful
+};
+
+/// \brief Controls what workers do when they run out of work.
+///
+/// \details Idle workers spin, then yield, then park until woken. Parking and
+/// waking is expensive relative to short gaps between bursts of work, so
+/// spinning or yielding for a while can substantially reduce latency at the
+/// cost of burning cycles.
+///
+typedef struct loom_idle_policy {
+  /// Maximum time to spin, in microseconds.
+  loom_uint32_t spin;
+
+  /// Time to yield after spinning, in microseconds.
+  loom_uint32_t yield;
+
+  /// \brief Adapt time spent spinning to the gaps between bursts of work.
+  ///
+  /// \details Workers track the average time they're idle for, and spin for
+  /// up to twice that, capped by `spin`. If work routinely takes longer than
+  /// `spin` to arrive, workers stop spinning altogether.
+  ///
+  loom_bool_t adaptive;
+} loom_idle_policy_t;
+
+/// Time spent idle by workers, in nanoseconds.
+typedef struct loom_idle_statistics {
+  loom_uint64_t spinning;
+  loom_uint64_t yielding;
+  loom_uint64_t parked;
+} loom_idle_statistics_t;
+
 typedef struct loom_options {
   /// Number of worker threads to spawn.
   ///
@@ -183,14 +393,71 @@ typedef struct loom_options {
   /// A callback to invoke after scheduling a task.
   loom_epilogue_t epilogue;
 
-  /// Size of task pool.
+  /// Initial size of task pool.
+  ///
+  /// \note The task pool grows on demand, so this should be sized for the
+  ///       common case rather than the worst case.
+  ///
   loom_size_t tasks;
 
-  /// Size of permit pool.
+  /// Initial size of permit pool.
+  ///
+  /// \note Like the task pool, the permit pool grows on demand.
+  ///
   loom_size_t permits;
 
-  /// Size of work queues.
+  /// Initial size of work queues.
+  ///
+  /// \note Work queues double in size whenever they fill, so this should be
+  ///       sized for the common case rather than the worst case.
+  ///
   loom_size_t queue;
+
+  /// Size of the queue used to submit tasks from threads other than the main
+  /// thread or a worker.
+  ///
+  /// \note Such threads will yield while the queue is full.
+  ///
+  loom_size_t injection;
+
+  /// How to back pools and work queues. One of `loom_pages`.
+  ///
+  /// \note Huge pages are only used for allocations of at least a huge page,
+  ///       which in practice means large pools.
+  ///
+  loom_uint32_t pages;
+
+  /// Place each worker's work queues on its NUMA node.
+  loom_bool_t numa;
+
+  /// \copydoc loom_idle_policy_t
+  ///
+  /// \note Workers park immediately if zeroed.
+  ///
+  loom_idle_policy_t idle;
+
+  /// Maximum number of fibers, and so fiber tasks that can be started but
+  /// not completed at any point in time.
+  ///
+  /// \note Fiber tasks that can't get a fiber run like any other task.
+  ///
+  /// \note If zero, a reasonable default is chosen.
+  ///
+  loom_size_t fibers;
+
+  /// Size of each fiber's stack, in bytes.
+  ///
+  /// \note If zero, a reasonable default is chosen.
+  ///
+  loom_size_t fiber_stack;
+
+  /// Maximum number of I/O operations that can be in flight at once.
+  ///
+  /// \note Operations beyond this are performed synchronously.
+  ///
+  /// \note If zero, a reasonable default is chosen.
+  ///
+  loom_uint32_t io;
 } loom_options_t;
 
 extern LOOM_PUBLIC
@@ -213,10 +480,96 @@ extern LOOM_PUBLIC
                               void *data,
                               loom_uint32_t flags);
 
+/// \brief Describes a task that runs @kernel with a copy of @payload.
+///
+/// \details Copies @size bytes from @payload into the task itself. The kernel
+/// is handed a pointer to the copy, which is valid until the kernel returns.
+///
+/// \warning @size must not exceed `LOOM_INLINE_PAYLOAD`.
+///
+extern LOOM_PUBLIC
+  loom_handle_t loom_describe_with_payload(loom_kernel_fn kernel,
+                                           const void *payload,
+                                           loom_size_t size,
+                                           loom_uint32_t flags);
+
+/// \brief Describes @n tasks that run @kernel, storing their handles in
+/// @handles.
+///
+/// \details Equivalent to calling `loom_describe` for each of @data, but
+/// acquires tasks in batches.
+///
+/// \note If @data is `NULL`, every task is handed `NULL`.
+///
+extern LOOM_PUBLIC
+  void loom_describe_n(unsigned n,
+                       loom_kernel_fn kernel,
+                       void *const *data,
+                       loom_uint32_t flags,
+                       loom_handle_t *handles);
+
+/// \brief Describes a task that runs @kernel on a fiber.
+///
+/// \details See `LOOM_WORK_FIBER`.
+///
+/// \note Fibers are only supported on x86_64 Linux, for now. Elsewhere, fiber
+///       tasks run like any other task.
+///
+extern LOOM_PUBLIC
+  loom_handle_t loom_describe_fiber(loom_kernel_fn kernel,
+                                    void *data,
+                                    loom_uint32_t flags);
+
+/// \brief Describes a task that performs @io.
+///
+/// \details See `LOOM_WORK_IO`. Copies @io into the task, but the buffer it
+/// refers to must remain valid until the task completes.
+///
+/// \note Asynchronous I/O is only supported on Linux, through io_uring, for
+///       now. Elsewhere, or if io_uring is unavailable, I/O tasks perform
+///       their operations synchronously on a worker.
+///
+extern LOOM_PUBLIC
+  loom_handle_t loom_describe_io(const loom_io_t *io,
+                                 loom_uint32_t flags);
+
 extern LOOM_PUBLIC
   void loom_permits(loom_handle_t task,
                     loom_handle_t permitee);
 
+/// \brief Permits each of @permitees to run after @task.
+///
+/// \details Equivalent to calling `loom_permits` for each of @permitees, but
+/// acquires permits in batches.
+///
+extern LOOM_PUBLIC
+  void loom_permits_n(loom_handle_t task,
+                      unsigned n,
+                      const loom_handle_t *permitees);
+
+/// \brief Continues the calling task with @kernel once @after is completed.
+///
+/// \details Rather than being completed when its kernel returns, the calling
+/// task is rescheduled to run @kernel with @data after @after, reusing its
+/// description. Tasks it permits, and any counter it was kicked with, are
+/// only released once its final continuation is completed. This lets tasks
+/// pause while asynchronous work is performed, and lets multi-stage pipelines
+/// run without describing a task per stage.
+///
+/// \warning Must be called from within a kernel, at most once per run.
+///
+/// \warning @after must not have been kicked yet. Kick it afterwards.
+///
+extern LOOM_PUBLIC
+  void loom_continue_with(loom_kernel_fn kernel,
+                          void *data,
+                          loom_handle_t after);
+
+/// \brief Kicks a task.
+///
+/// \note Can be called from any thread. Tasks kicked from threads other than
+///       the main thread or a worker are queued for workers to pick up.
+///
 extern LOOM_PUBLIC
   void loom_kick(loom_handle_t task);
 
@@ -224,6 +577,37 @@ extern LOOM_PUBLIC
   void loom_kick_n(unsigned n,
                    const loom_handle_t *tasks);
 
+/// \brief Kicks a task, incrementing @counter until it's completed.
+extern LOOM_PUBLIC
+  void loom_kick_with_counter(loom_handle_t task,
+                              loom_counter_t *counter);
+
+/// \brief Kicks all tasks, incrementing @counter until each is completed.
+extern LOOM_PUBLIC
+  void loom_kick_with_counter_n(unsigned n,
+                                const loom_handle_t *tasks,
+                                loom_counter_t *counter);
+
+/// \brief Returns the number of outstanding tasks counted by @counter.
+extern LOOM_PUBLIC
+  loom_uint32_t loom_counter_value(const loom_counter_t *counter);
+
+/// \brief Waits until @counter drops to @value.
+///
+/// \details Does work while waiting when called from the main thread or a
+/// worker, including from within a task. Otherwise blocks.
+///
+/// \note Fiber tasks are suspended instead.
+///
+/// \warning Threads waiting on the same counter at the same time must wait
+///          for the same value.
+///
+/// \warning Only one fiber task can wait on a counter at a time.
+///
+extern LOOM_PUBLIC
+  void loom_wait_for_counter(loom_counter_t *counter,
+                             loom_uint32_t value);
+
 /// \brief Kicks a task and waits for it to be completed.
 extern LOOM_PUBLIC
   void loom_kick_and_wait(loom_handle_t task);
@@ -242,6 +626,180 @@ extern LOOM_PUBLIC
   void loom_kick_and_do_work_while_waiting_n(unsigned n,
                                              const loom_handle_t *tasks);
 
+/// \brief Calls @kernel over [@begin, @end) in parallel, in chunks of at
+/// most @grain iterations, and waits for all to be completed.
+///
+/// \details Ranges are split in half lazily, only when a worker's queue runs
+/// dry, so the number of tasks adapts to the number of workers free to steal
+/// them. Does work while waiting, like `loom_wait_for_counter`.
+///
+/// \note If @grain is zero, ranges are split down to single iterations.
+///
+extern LOOM_PUBLIC
+  void loom_parallel_for(loom_size_t begin,
+                         loom_size_t end,
+                         loom_size_t grain,
+                         loom_range_fn kernel,
+                         void *data);
+
+/// \brief Reduces [@begin, @end) in parallel, storing the result in
+/// @result.
+///
+/// \details The main thread and each worker accumulate chunks of at most
+/// @grain iterations into their own partial result of @size bytes, by calling
+/// @reduce. Partial results start out as copies of @identity and are kept on
+/// separate cache lines. Once all chunks are completed, partial results are
+/// folded into @result by calling @combine.
+///
+/// \warning Partial results are combined in no particular order, so @combine
+///          must be associative and commutative.
+///
+/// \warning @reduce must not wait on other tasks.
+///
+/// \warning Workers must not be brought up while reducing.
+///
+extern LOOM_PUBLIC
+  void loom_parallel_reduce(loom_size_t begin,
+                            loom_size_t end,
+                            loom_size_t grain,
+                            loom_size_t size,
+                            const void *identity,
+                            loom_reduce_fn reduce,
+                            loom_combine_fn combine,
+                            void *data,
+                            void *result);
+
+/// \brief Scans [@begin, @end) in parallel.
+///
+/// \details Performs a two-pass scan. The range is split into a few blocks
+/// per thread, of at least @grain iterations, and each block is reduced into
+/// a partial result of @size bytes by calling @reduce. Partial results start
+/// out as copies of @identity. Then, each block is scanned by calling @scan
+/// with the combination of all blocks before it, in order, by @combine.
+///
+/// \warning @combine must be associative, and combines @from into the right
+///          of @into.
+///
+extern LOOM_PUBLIC
+  void loom_parallel_scan(loom_size_t begin,
+                          loom_size_t end,
+                          loom_size_t grain,
+                          loom_size_t size,
+                          const void *identity,
+                          loom_reduce_fn reduce,
+                          loom_combine_fn combine,
+                          loom_scan_fn scan,
+                          void *data);
+
+/// \brief Creates a graph of tasks that can be recorded once, then replayed
+/// any number of times.
+///
+/// \details Graphs own their tasks, so replaying them doesn't describe tasks
+/// or acquire permits. Instead, each task's blockers are reset to its number
+/// of predecessors, and those without any are kicked.
+///
+extern LOOM_PUBLIC
+  loom_graph_t *loom_graph_create(void);
+
+/// \warning @graph must not be being replayed.
+extern LOOM_PUBLIC
+  void loom_graph_destroy(loom_graph_t *graph);
+
+/// \brief Records a task that runs @kernel.
+///
+/// \returns The index of the task in @graph, to refer to it by.
+///
+/// \warning @graph must not have been compiled yet.
+///
+extern LOOM_PUBLIC
+  loom_uint32_t loom_graph_add(loom_graph_t *graph,
+                               loom_kernel_fn kernel,
+                               void *data,
+                               loom_uint32_t flags);
+
+/// \brief Records that the task at @from permits the task at @to to run.
+///
+/// \warning @graph must not have been compiled yet.
+///
+extern LOOM_PUBLIC
+  void loom_graph_add_edge(loom_graph_t *graph,
+                           loom_uint32_t from,
+                           loom_uint32_t to);
+
+/// \brief Freezes @graph, precomputing successors and roots.
+///
+/// \returns False if @graph has a cycle, as it could never be completed. It's
+/// left uncompiled and can't be replayed.
+///
+extern LOOM_PUBLIC
+  loom_bool_t loom_graph_compile(loom_graph_t *graph);
+
+/// \brief Kicks all tasks in @graph and waits for all to be completed.
+///
+/// \details Does work while waiting, like `loom_wait_for_counter`.
+///
+/// \warning Replays of the same graph must not overlap.
+///
+extern LOOM_PUBLIC
+  void loom_graph_replay(loom_graph_t *graph);
+
+/// \brief Creates an arena that tasks can allocate scratch memory from.
+///
+/// \details Each worker allocates from its own blocks of @size_of_each_block
+/// bytes, so allocations are little more than bumping a pointer. Memory is
+/// never freed individually. Instead, the whole arena is reset at once,
+/// typically by `loom_kick_and_wait_with_arena_n` once a graph completes.
+///
+/// \note If @size_of_each_block is zero, a reasonable default is chosen.
+///
+extern LOOM_PUBLIC
+  loom_arena_t *loom_arena_create(loom_size_t size_of_each_block);
+
+extern LOOM_PUBLIC
+  void loom_arena_destroy(loom_arena_t *arena);
+
+/// \brief Allocates @size bytes aligned to @alignment from @arena.
+///
+/// \note Can be called from any thread, but threads other than the main
+///       thread or a worker share a slab guarded by a lock.
+///
+extern LOOM_PUBLIC
+  void *loom_arena_alloc(loom_arena_t *arena,
+                         loom_size_t size,
+                         loom_size_t alignment);
+
+/// \brief Releases all allocations made from @arena at once.
+///
+/// \warning Nothing may be allocating from @arena while it's reset.
+///
+extern LOOM_PUBLIC
+  void loom_arena_reset(loom_arena_t *arena);
+
+/// \brief Kicks all tasks, waits for all to be completed, then resets
+/// @arena.
+///
+/// \warning Only @tasks are waited on, so tasks they permit must not
+///          allocate from @arena unless also completed by then.
+///
+extern LOOM_PUBLIC
+  void loom_kick_and_wait_with_arena_n(unsigned n,
+                                       const loom_handle_t *tasks,
+                                       loom_arena_t *arena);
+
+/// \brief Kicks all tasks, does work while waiting for all to be completed,
+/// then resets @arena.
+///
+/// \copydetails loom_kick_and_wait_with_arena_n
+///
+extern LOOM_PUBLIC
+  void loom_kick_and_do_work_while_waiting_with_arena_n(unsigned n,
+                                                        const loom_handle_t *tasks,
+                                                        loom_arena_t *arena);
+
+/// \brief Sums time spent idle by all workers, since initialization.
+extern LOOM_PUBLIC
+  void loom_idle_statistics(loom_idle_statistics_t *statistics);
+
 /// \brief Schedules an available task, if there are any.
 /// \warning You should only call this from the main thread!
 /// \returns If a task was completed, i.e. if some work was performed.
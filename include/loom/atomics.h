@@ -24,9 +24,12 @@
       LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64
     #pragma intrinsic(_InterlockedIncrement)
     #pragma intrinsic(_InterlockedDecrement)
+    #pragma intrinsic(_InterlockedExchange)
+    #pragma intrinsic(_InterlockedExchangeAdd)
     #pragma intrinsic(_InterlockedCompareExchange)
     #pragma intrinsic(_interlockedbittestandset)
     #pragma intrinsic(_interlockedbittestandreset)
+    #pragma intrinsic(_mm_pause)
 
     #if LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64
       #pragma intrinsic(_InterlockedIncrement64)
@@ -54,6 +57,7 @@ LOOM_BEGIN_EXTERN_C
   #define loom_atomic_release() _ReadWriteBarrier()
   #define loom_atomic_fence() _ReadWriteBarrier()
   #define loom_atomic_barrier() MemoryBarrier()
+  #define loom_atomic_pause() _mm_pause()
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
   #define loom_atomic_acquire() asm volatile("" ::: "memory")
@@ -64,6 +68,7 @@ LOOM_BEGIN_EXTERN_C
   #elif LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64
     #define loom_atomic_barrier() asm volatile("lock; orl $0, (%%rsp)" ::: "memory")
   #endif
+  #define loom_atomic_pause() asm volatile("pause" ::: "memory")
 #endif
 
 static LOOM_INLINE loom_uint32_t loom_atomic_load_u32(const volatile loom_uint32_t *m) {
@@ -87,6 +92,7 @@ static LOOM_INLINE loom_uint32_t loom_atomic_cmp_and_xchg_u32(volatile loom_uint
   return _InterlockedCompareExchange((volatile long *)m, desired, expected);
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
+  return __sync_val_compare_and_swap(m, expected, desired);
 #endif
 }
 
@@ -95,6 +101,7 @@ static LOOM_INLINE loom_uint32_t loom_atomic_incr_u32(volatile loom_uint32_t *m)
   return _InterlockedIncrement((volatile long *)m);
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
+  return __sync_add_and_fetch(m, 1);
 #endif
 }
 
@@ -103,6 +110,27 @@ static LOOM_INLINE loom_uint32_t loom_atomic_decr_u32(volatile loom_uint32_t *m)
   return _InterlockedDecrement((volatile long *)m);
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
+  return __sync_sub_and_fetch(m, 1);
+#endif
+}
+
+/// Adds @v to @m, returning the previous value of @m.
+static LOOM_INLINE loom_uint32_t loom_atomic_fetch_and_add_u32(volatile loom_uint32_t *m, loom_uint32_t v) {
+#if LOOM_COMPILER == LOOM_COMPILER_MSVC
+  return _InterlockedExchangeAdd((volatile long *)m, v);
+#elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
+      LOOM_COMPILER == LOOM_COMPILER_GCC
+  return __sync_fetch_and_add(m, v);
+#endif
+}
+
+/// Exchanges @m with @v, returning the previous value of @m.
+static LOOM_INLINE loom_uint32_t loom_atomic_xchg_u32(volatile loom_uint32_t *m, loom_uint32_t v) {
+#if LOOM_COMPILER == LOOM_COMPILER_MSVC
+  return _InterlockedExchange((volatile long *)m, v);
+#elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
+      LOOM_COMPILER == LOOM_COMPILER_GCC
+  return __atomic_exchange_n(m, v, __ATOMIC_SEQ_CST);
 #endif
 }
 
@@ -111,6 +139,7 @@ static LOOM_INLINE unsigned loom_atomic_set_u32(volatile loom_uint32_t *m, unsig
   return _interlockedbittestandset((volatile long *)m, bit);
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
+  return (__sync_fetch_and_or(m, 1ul << bit) >> bit) & 1;
 #endif
 }
 
@@ -119,6 +148,7 @@ static LOOM_INLINE unsigned loom_atomic_reset_u32(volatile loom_uint32_t *m, uns
   return _interlockedbittestandreset((volatile long *)m, bit);
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
+  return (__sync_fetch_and_and(m, ~(1ul << bit)) >> bit) & 1;
 #endif
 }
 
@@ -147,6 +177,7 @@ static LOOM_INLINE unsigned loom_atomic_reset_u32(volatile loom_uint32_t *m, uns
     return _InterlockedCompareExchange64((volatile __int64 *)m, desired, expected);
   #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
         LOOM_COMPILER == LOOM_COMPILER_GCC
+    return __sync_val_compare_and_swap(m, expected, desired);
   #endif
   }
 
@@ -155,6 +186,7 @@ static LOOM_INLINE unsigned loom_atomic_reset_u32(volatile loom_uint32_t *m, uns
     return _InterlockedIncrement64((volatile __int64 *)m);
   #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
         LOOM_COMPILER == LOOM_COMPILER_GCC
+    return __sync_add_and_fetch(m, 1);
   #endif
   }
 
@@ -163,6 +195,7 @@ static LOOM_INLINE unsigned loom_atomic_reset_u32(volatile loom_uint32_t *m, uns
     return _InterlockedDecrement64((volatile __int64 *)m);
   #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
         LOOM_COMPILER == LOOM_COMPILER_GCC
+    return __sync_sub_and_fetch(m, 1);
   #endif
   }
 
@@ -171,6 +204,7 @@ static LOOM_INLINE unsigned loom_atomic_reset_u32(volatile loom_uint32_t *m, uns
     return _interlockedbittestandset64((volatile __int64 *)m, bit);
   #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
         LOOM_COMPILER == LOOM_COMPILER_GCC
+    return (__sync_fetch_and_or(m, 1ull << bit) >> bit) & 1;
   #endif
   }
 
@@ -179,6 +213,7 @@ static LOOM_INLINE unsigned loom_atomic_reset_u32(volatile loom_uint32_t *m, uns
     return _interlockedbittestandreset64((volatile __int64 *)m, bit);
   #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
         LOOM_COMPILER == LOOM_COMPILER_GCC
+    return (__sync_fetch_and_and(m, ~(1ull << bit)) >> bit) & 1;
   #endif
   }
 #endif
@@ -197,6 +232,27 @@ static LOOM_INLINE void loom_atomic_store_ptr(void *volatile *m, void *v) {
 #endif
 }
 
+/// Exchanges @m with @v, returning the previous value of @m.
+static LOOM_INLINE void *loom_atomic_xchg_ptr(void *volatile *m, void *v) {
+#if LOOM_COMPILER == LOOM_COMPILER_MSVC
+  return _InterlockedExchangePointer(m, v);
+#elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
+      LOOM_COMPILER == LOOM_COMPILER_GCC
+  return __atomic_exchange_n(m, v, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static LOOM_INLINE void *loom_atomic_cmp_and_xchg_ptr(void *volatile *m,
+                                                      void *expected,
+                                                      void *desired) {
+#if LOOM_COMPILER == LOOM_COMPILER_MSVC
+  return _InterlockedCompareExchangePointer(m, desired, expected);
+#elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
+      LOOM_COMPILER == LOOM_COMPILER_GCC
+  return __sync_val_compare_and_swap(m, expected, desired);
+#endif
+}
+
 #if LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86
   #define loom_atomic_load_native(m) loom_atomic_load_u32(m)
   #define loom_atomic_store_native(m, v) loom_atomic_store_u32(m, v)
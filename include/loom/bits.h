@@ -49,7 +49,7 @@ static LOOM_INLINE unsigned loom_clz_u32(loom_uint32_t v) {
   return _BitScanReverse((unsigned long *)&bit, v) ? (31 - bit) : 32;
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
-  return v ? __builtin_clzl(v) : 32;
+  return v ? __builtin_clz(v) : 32;
 #endif
 }
 
@@ -60,7 +60,7 @@ static LOOM_INLINE unsigned loom_ctz_u32(loom_uint32_t v) {
   return _BitScanForward((unsigned long *)&bit, v) ? bit : 32;
 #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
       LOOM_COMPILER == LOOM_COMPILER_GCC
-  return v ? __builtin_ctzl(v) : 32;
+  return v ? __builtin_ctz(v) : 32;
 #endif
 }
 
@@ -72,7 +72,7 @@ static LOOM_INLINE unsigned loom_ctz_u32(loom_uint32_t v) {
     return _BitScanReverse64(&bit, v) ? (63 - bit) : 64;
   #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
         LOOM_COMPILER == LOOM_COMPILER_GCC
-    return v ? __builtin_clzl(v) : 64;
+    return v ? __builtin_clzll(v) : 64;
   #endif
   }
 
@@ -83,7 +83,7 @@ static LOOM_INLINE unsigned loom_ctz_u32(loom_uint32_t v) {
     return _BitScanForward64(&bit, v) ? bit : 64;
   #elif LOOM_COMPILER == LOOM_COMPILER_CLANG || \
         LOOM_COMPILER == LOOM_COMPILER_GCC
-    return v ? __builtin_ctzl(v) : 32;
+    return v ? __builtin_ctzll(v) : 64;
   #endif
   }
 #endif
@@ -0,0 +1,31 @@
+//===-- loom/clock.h ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LOOM_CLOCK_H_
+#define _LOOM_CLOCK_H_
+
+#include "loom/config.h"
+#include "loom/linkage.h"
+
+#include "loom/types.h"
+
+LOOM_BEGIN_EXTERN_C
+
+/// \brief Returns the current time in nanoseconds, from an arbitrary epoch.
+///
+/// \note The clock is monotonic, so it's only meaningful to compare times.
+///
+extern LOOM_LOCAL
+  loom_uint64_t loom_clock_now(void);
+
+LOOM_END_EXTERN_C
+
+#endif // _LOOM_CLOCK_H_
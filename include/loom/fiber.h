@@ -0,0 +1,94 @@
+//===-- loom/fiber.h ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LOOM_FIBER_H_
+#define _LOOM_FIBER_H_
+
+#include "loom/config.h"
+#include "loom/linkage.h"
+
+#include "loom/types.h"
+
+LOOM_BEGIN_EXTERN_C
+
+/// \def LOOM_FIBERS
+/// \brief Non-zero if fibers are supported on the target.
+///
+/// \note Only implemented for x86_64 Linux, for now.
+///
+#if LOOM_PLATFORM == LOOM_PLATFORM_LINUX && \
+    LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64 && \
+    (LOOM_COMPILER == LOOM_COMPILER_GCC || LOOM_COMPILER == LOOM_COMPILER_CLANG)
+  #define LOOM_FIBERS 1
+#else
+  #define LOOM_FIBERS 0
+#endif
+
+#if LOOM_FIBERS
+
+/// \brief A suspended execution context.
+///
+/// \details Points to the callee-saved registers pushed to the top of the
+/// context's stack when it was suspended.
+///
+typedef void *loom_fiber_context_t;
+
+typedef void (*loom_fiber_entry_fn)(void *);
+
+/// \brief Maps a stack of at least @size bytes, preceded by a guard page.
+///
+/// \details Overflowing the stack faults on the guard page rather than
+/// silently corrupting whatever is mapped below it.
+///
+/// \returns The lowest usable address of the stack.
+///
+extern LOOM_LOCAL
+  void *loom_fiber_stack_alloc(loom_size_t size);
+
+/// \brief Unmaps a stack mapped by `loom_fiber_stack_alloc`.
+///
+/// \warning @size must match that passed to `loom_fiber_stack_alloc`.
+///
+extern LOOM_LOCAL
+  void loom_fiber_stack_free(void *stack,
+                             loom_size_t size);
+
+/// \brief Prepares a context that calls @entry with @argument on @stack
+/// once switched to.
+///
+/// \warning @entry must never return. Switch to another context instead.
+///
+extern LOOM_LOCAL
+  loom_fiber_context_t loom_fiber_prepare(void *stack,
+                                          loom_size_t size,
+                                          loom_fiber_entry_fn entry,
+                                          void *argument);
+
+/// \brief Suspends the calling context, storing it in @from, and resumes
+/// @to.
+///
+/// \details Only callee-saved registers and floating-point control words are
+/// saved, as required by the System V ABI, so switching costs little more
+/// than a function call.
+///
+/// \warning Compilers may cache the address of thread-local storage across
+///          calls. Code that can be resumed on another thread must not touch
+///          thread-locals in the same function after calling this.
+///
+extern LOOM_LOCAL
+  void loom_fiber_switch(loom_fiber_context_t *from,
+                         loom_fiber_context_t to);
+
+#endif
+
+LOOM_END_EXTERN_C
+
+#endif // _LOOM_FIBER_H_
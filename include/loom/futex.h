@@ -0,0 +1,60 @@
+//===-- loom/futex.h ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LOOM_FUTEX_H_
+#define _LOOM_FUTEX_H_
+
+#include "loom/config.h"
+#include "loom/linkage.h"
+
+#include "loom/types.h"
+
+LOOM_BEGIN_EXTERN_C
+
+// Backed by futexes on Linux, and `WaitOnAddress` on Windows 8 and later. Not
+// available on macOS.
+
+/// \def LOOM_FUTEX_FOREVER
+/// \brief A deadline that never passes.
+#define LOOM_FUTEX_FOREVER 0xffffffffffffffffull
+
+/// \brief Converts a timeout in milliseconds to a deadline.
+///
+/// \note A timeout of `-1` results in `LOOM_FUTEX_FOREVER`.
+///
+extern LOOM_LOCAL
+  loom_uint64_t loom_futex_deadline(unsigned timeout);
+
+/// \brief Blocks the calling thread while @address holds @expected, until
+/// woken or @deadline passes.
+///
+/// \returns False if @deadline passed, otherwise true.
+///
+/// \warning May return spuriously, so callers must check for whatever they're
+///          waiting on themselves.
+///
+extern LOOM_LOCAL
+  loom_bool_t loom_futex_wait(volatile loom_uint32_t *address,
+                              loom_uint32_t expected,
+                              loom_uint64_t deadline);
+
+/// Wakes up to @n threads blocked on @address.
+extern LOOM_LOCAL
+  void loom_futex_wake(volatile loom_uint32_t *address,
+                       unsigned n);
+
+/// Wakes all threads blocked on @address.
+extern LOOM_LOCAL
+  void loom_futex_wake_all(volatile loom_uint32_t *address);
+
+LOOM_END_EXTERN_C
+
+#endif // _LOOM_FUTEX_H_
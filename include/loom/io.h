@@ -0,0 +1,110 @@
+//===-- loom/io.h ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LOOM_IO_H_
+#define _LOOM_IO_H_
+
+#include "loom/config.h"
+#include "loom/linkage.h"
+
+#include "loom/types.h"
+
+LOOM_BEGIN_EXTERN_C
+
+/// \def LOOM_IO_URING
+/// \brief Non-zero if I/O can be performed asynchronously through io_uring.
+#if LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  #define LOOM_IO_URING 1
+#else
+  #define LOOM_IO_URING 0
+#endif
+
+/// Operations that can be performed.
+enum loom_io_ring_op {
+  LOOM_IO_RING_READ  = 0,
+  LOOM_IO_RING_WRITE = 1,
+  LOOM_IO_RING_FSYNC = 2,
+
+  // Does nothing but complete. Used to wake whoever is waiting on a ring.
+  LOOM_IO_RING_NOP   = 3
+};
+
+typedef struct loom_io_ring loom_io_ring_t;
+
+typedef struct loom_io_completion {
+  void *user;
+  loom_int64_t result;
+} loom_io_completion_t;
+
+/// \brief Creates a ring that can have up to @entries operations queued.
+///
+/// \details Only the raw system calls are used, so no dependency on liburing
+/// is needed.
+///
+/// \returns NULL if io_uring is unavailable, or lacks any operation we need.
+///
+extern LOOM_LOCAL
+  loom_io_ring_t *loom_io_ring_create(unsigned entries);
+
+extern LOOM_LOCAL
+  void loom_io_ring_destroy(loom_io_ring_t *ring);
+
+/// \brief Submits an operation, tagged with @user.
+///
+/// \returns False if @ring is full.
+///
+/// \note Can be called from any thread.
+///
+extern LOOM_LOCAL
+  loom_bool_t loom_io_ring_submit(loom_io_ring_t *ring,
+                                  loom_uint32_t op,
+                                  loom_int32_t fd,
+                                  void *buffer,
+                                  loom_size_t size,
+                                  loom_uint64_t offset,
+                                  void *user);
+
+/// Returns true if any completions are waiting to be reaped.
+extern LOOM_LOCAL
+  loom_bool_t loom_io_ring_any_completed(const loom_io_ring_t *ring);
+
+/// \brief Reaps up to @n completions into @completions, without blocking.
+///
+/// \returns The number reaped.
+///
+/// \note Can be called from any thread.
+///
+extern LOOM_LOCAL
+  unsigned loom_io_ring_reap(loom_io_ring_t *ring,
+                             loom_io_completion_t *completions,
+                             unsigned n);
+
+/// \brief Blocks until at least one completion is waiting to be reaped.
+///
+/// \warning May return spuriously.
+///
+extern LOOM_LOCAL
+  void loom_io_ring_wait(loom_io_ring_t *ring);
+
+/// \brief Performs an operation synchronously.
+///
+/// \returns Number of bytes transferred, or a negated `errno`.
+///
+extern LOOM_LOCAL
+  loom_int64_t loom_io_perform(loom_uint32_t op,
+                               loom_int32_t fd,
+                               void *buffer,
+                               loom_size_t size,
+                               loom_uint64_t offset);
+
+LOOM_END_EXTERN_C
+
+#endif // _LOOM_IO_H_
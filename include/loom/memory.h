@@ -0,0 +1,76 @@
+//===-- loom/memory.h -----------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LOOM_MEMORY_H_
+#define _LOOM_MEMORY_H_
+
+#include "loom/config.h"
+#include "loom/linkage.h"
+
+#include "loom/types.h"
+
+LOOM_BEGIN_EXTERN_C
+
+/// Allocates @size bytes of zeroed memory aligned to @alignment.
+extern LOOM_LOCAL
+  void *loom_memory_alloc(loom_size_t size,
+                          loom_size_t alignment);
+
+/// Frees memory allocated by `loom_memory_alloc`.
+extern LOOM_LOCAL
+  void loom_memory_free(void *memory);
+
+/// Flags that control how memory is mapped by `loom_memory_map`.
+enum loom_memory_flags {
+  /// Advise the kernel to back large mappings with huge pages, if it can.
+  LOOM_MEMORY_TRANSPARENT_HUGE_PAGES = (1 << 0),
+
+  /// Back large mappings with explicitly reserved huge pages, falling back to
+  /// transparent huge pages if none are available.
+  LOOM_MEMORY_HUGE_PAGES = (1 << 1)
+};
+
+/// \def LOOM_MEMORY_ANY_NODE
+/// \brief Place memory wherever the kernel sees fit.
+#define LOOM_MEMORY_ANY_NODE -1
+
+/// \brief Maps @size bytes of zeroed memory directly from the kernel.
+///
+/// \details Mappings are page aligned. If @node isn't `LOOM_MEMORY_ANY_NODE`
+/// then the mapping is placed on that NUMA node, where supported.
+///
+/// \note Huge pages are only used for mappings of at least a huge page, so
+///       small mappings don't waste memory.
+///
+extern LOOM_LOCAL
+  void *loom_memory_map(loom_size_t size,
+                        loom_uint32_t flags,
+                        loom_int32_t node);
+
+/// \brief Unmaps memory mapped by `loom_memory_map`.
+///
+/// \warning @size and @flags must match those passed to `loom_memory_map`.
+///
+extern LOOM_LOCAL
+  void loom_memory_unmap(void *memory,
+                         loom_size_t size,
+                         loom_uint32_t flags);
+
+/// \brief Determines the NUMA node @core belongs to.
+///
+/// \returns `LOOM_MEMORY_ANY_NODE` if unknown.
+///
+extern LOOM_LOCAL
+  loom_int32_t loom_memory_node_of_core(unsigned core);
+
+LOOM_END_EXTERN_C
+
+#endif // _LOOM_MEMORY_H_
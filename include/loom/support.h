@@ -27,6 +27,18 @@
   #endif
 #endif
 
+/// \def LOOM_NOINLINE
+/// \brief Code should never be inlined.
+#if defined(DOXYGEN)
+  #define LOOM_NOINLINE
+#else
+  #if defined(_MSC_VER)
+    #define LOOM_NOINLINE __declspec(noinline)
+  #elif defined(__clang__) || defined(__GNUC__)
+    #define LOOM_NOINLINE __attribute__ ((noinline))
+  #endif
+#endif
+
 /// \def LOOM_TRAP
 /// \brief Errant, but reachable, code path.
 #if defined(DOXYGEN)
@@ -58,6 +70,24 @@
   #endif
 #endif
 
+/// \def LOOM_ALIGNED
+/// \brief Aligns a type or variable to `n` bytes.
+#if defined(DOXYGEN)
+  #define LOOM_ALIGNED(n)
+#else
+  #if defined(_MSC_VER)
+    #define LOOM_ALIGNED(n) __declspec(align(n))
+  #elif defined(__clang__) || defined(__GNUC__)
+    #define LOOM_ALIGNED(n) __attribute__ ((aligned(n)))
+  #endif
+#endif
+
+/// \def LOOM_CACHE_LINE
+/// \brief Size of a cache line, in bytes.
+#ifndef LOOM_CACHE_LINE
+  #define LOOM_CACHE_LINE 64
+#endif
+
 /// \def LOOM_THREAD_LOCAL
 /// \brief Marks a static variable as "thread local" meaning each thread
 /// has its own unique copy.
@@ -17,7 +17,13 @@
 #include "loom/lock.h"
 #include "loom/event.h"
 #include "loom/prng.h"
+#include "loom/memory.h"
+#include "loom/clock.h"
+#include "loom/futex.h"
+#include "loom/fiber.h"
+#include "loom/io.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -39,6 +45,53 @@ const loom_handle_t LOOM_INVALID_HANDLE = {
 #endif
 };
 
+/// \brief A circular array of tasks backing a work queue.
+///
+/// \details Buffers are never resized in place. Instead, a work queue swaps
+/// in a buffer twice the size of the current one and copies over any queued
+/// tasks. See `loom_work_queue_grow`.
+///
+typedef struct loom_work_queue_buffer {
+  loom_uint32_t size;
+  loom_uint32_t size_minus_one;
+
+  // Previous, smaller buffer. Kept around until the work queue is destroyed,
+  // as thieves may still be reading from it.
+  struct loom_work_queue_buffer *retired;
+
+  loom_task_t *tasks[0];
+} loom_work_queue_buffer_t;
+
+static loom_size_t loom_work_queue_buffer_footprint(loom_uint32_t size) {
+  return sizeof(loom_work_queue_buffer_t) + size * sizeof(loom_task_t *);
+}
+
+static loom_work_queue_buffer_t *loom_work_queue_buffer_alloc(loom_uint32_t size,
+                                                              loom_uint32_t flags,
+                                                              loom_int32_t node) {
+  // Sizes must be a power of two so we can mask rather than divide.
+  loom_assert_debug((size & (size - 1)) == 0);
+
+  loom_work_queue_buffer_t *buffer =
+    (loom_work_queue_buffer_t *)loom_memory_map(loom_work_queue_buffer_footprint(size), flags, node);
+
+  buffer->size = size;
+  buffer->size_minus_one = size - 1;
+
+  buffer->retired = NULL;
+
+  return buffer;
+}
+
+static void loom_work_queue_buffer_free(loom_work_queue_buffer_t *buffer,
+                                        loom_uint32_t flags) {
+  while (buffer) {
+    loom_work_queue_buffer_t *retired = buffer->retired;
+    loom_memory_unmap((void *)buffer, loom_work_queue_buffer_footprint(buffer->size), flags);
+    buffer = retired;
+  }
+}
+
 /// \brief A lock-free, single-producer, multiple-consumer, doubly-ended queue
 /// of tasks.
 ///
@@ -50,35 +103,105 @@ const loom_handle_t LOOM_INVALID_HANDLE = {
 /// in their paper "Dynamic Circular Work-Stealing Deque." A more approachable
 /// description is available on Stefan Reinalter's blog.
 ///
-/// \warning Do not pop in any thread other than the producer thread!
+/// Thieves steal up to half of a queue at a time, rather than a single task,
+/// to reduce contention on `top` when a single producer fans out. See
+/// `loom_work_queue_steal` and `loom_work_queue_reach`.
 ///
-typedef struct loom_work_queue {
+/// \warning Do not push or pop in any thread other than the producer thread!
+///
+typedef struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_work_queue {
+  // Written by thieves, so kept apart from everything else to prevent false
+  // sharing with the producer.
   loom_uint32_t top;
-  loom_uint32_t bottom;
 
-  loom_task_t **tasks;
+  // Everything from here on is only written by the producer.
+  LOOM_ALIGNED(LOOM_CACHE_LINE) loom_uint32_t bottom;
 
-  loom_uint32_t size;
-  loom_uint32_t size_minus_one;
+  // Only ever replaced by the producer, when growing.
+  loom_work_queue_buffer_t *buffer;
+
+  // Bookkeeping used by the producer to determine how many tasks a thief
+  // could be part way through stealing. Only touched by the producer.
+  loom_uint32_t observed;
+  loom_uint32_t watermark;
+  loom_uint32_t peak;
+
+  // How and where to map buffers. See `loom_memory_map`.
+  loom_uint32_t flags;
+  loom_int32_t node;
 } loom_work_queue_t;
 
-static loom_work_queue_t *loom_work_queue_create(loom_size_t size) {
+/// \def LOOM_STEAL_LIMIT
+/// \brief Maximum number of tasks stolen at once.
+#ifndef LOOM_STEAL_LIMIT
+  #define LOOM_STEAL_LIMIT 32
+#endif
+
+// Smallest work queue we'll allocate, to avoid repeatedly growing from tiny.
+#define LOOM_MINIMUM_WORK_QUEUE_SIZE 64
+
+static loom_work_queue_t *loom_work_queue_create(loom_size_t size,
+                                                 loom_uint32_t flags,
+                                                 loom_int32_t node) {
   loom_work_queue_t *wq =
-    (loom_work_queue_t *)calloc(1, sizeof(loom_work_queue_t));
+    (loom_work_queue_t *)loom_memory_alloc(sizeof(loom_work_queue_t), LOOM_CACHE_LINE);
 
   wq->top = wq->bottom = 0;
 
-  wq->tasks = (loom_task_t **)calloc(size, sizeof(loom_task_t *));
+  wq->observed = 0;
+  wq->watermark = 0;
+  wq->peak = 0;
+
+  wq->flags = flags;
+  wq->node = node;
+
+  // Round up to a power of two.
+  loom_uint32_t rounded = LOOM_MINIMUM_WORK_QUEUE_SIZE;
+  while (rounded < size)
+    rounded <<= 1;
 
-  wq->size = size;
-  wq->size_minus_one = size - 1;
+  wq->buffer = loom_work_queue_buffer_alloc(rounded, flags, node);
 
   return wq;
 }
 
 void loom_work_queue_destroy(loom_work_queue_t *wq) {
-  free((void *)wq->tasks);
-  free((void *)wq);
+  loom_work_queue_buffer_free(wq->buffer, wq->flags);
+  loom_memory_free((void *)wq);
+}
+
+/// \brief Doubles the size of @wq, copying over tasks between @top and
+/// @bottom.
+///
+/// \details The old buffer is retired rather than freed, since a thief may
+/// have loaded it prior to the swap and still be reading from it. Retired
+/// buffers are reclaimed when @wq is destroyed. As buffers double in size,
+/// the memory held by retired buffers never exceeds that of the live one.
+///
+static loom_work_queue_buffer_t *loom_work_queue_grow(loom_work_queue_t *wq,
+                                                      loom_uint32_t top,
+                                                      loom_uint32_t bottom) {
+  loom_work_queue_buffer_t *old = wq->buffer;
+
+  // We can't index more than 2^31 tasks with our signed arithmetic.
+  loom_assert_debug(old->size < 0x80000000ul);
+
+  loom_work_queue_buffer_t *buffer = loom_work_queue_buffer_alloc(old->size * 2, wq->flags, wq->node);
+
+  // Thieves may advance `top` while we copy, in which case we copy a few
+  // tasks that have already been stolen. They'll never be observed, so it's
+  // harmless.
+  for (loom_uint32_t index = top; index != bottom; ++index)
+    buffer->tasks[index & buffer->size_minus_one] = old->tasks[index & old->size_minus_one];
+
+  buffer->retired = old;
+
+  // Ensure copies are published prior to swapping.
+  loom_atomic_barrier();
+
+  loom_atomic_store_ptr((void *volatile *)&wq->buffer, (void *)buffer);
+
+  return buffer;
 }
 
 /// Pushes @task into @wq, returning the new depth of @wq.
@@ -86,65 +209,208 @@ static loom_uint32_t loom_work_queue_push(loom_work_queue_t *wq, loom_task_t *ta
   const loom_uint32_t bottom = loom_atomic_load_u32(&wq->bottom);
   const loom_uint32_t top = loom_atomic_load_u32(&wq->top);
 
-  // Make sure we won't overflow the dequeue.
-  loom_assert_debug((bottom - top) <= wq->size);
+  loom_work_queue_buffer_t *buffer = wq->buffer;
 
-  loom_atomic_store_ptr((void *volatile *)&wq->tasks[bottom % wq->size], (void *)task);
+  if ((bottom - top) >= buffer->size)
+    // Grow rather than overwrite queued tasks.
+    buffer = loom_work_queue_grow(wq, top, bottom);
+
+  loom_atomic_store_ptr((void *volatile *)&buffer->tasks[bottom & buffer->size_minus_one], (void *)task);
 
   // Ensure task is published prior to advertising.
   loom_atomic_barrier();
 
   loom_atomic_store_u32(&wq->bottom, bottom + 1);
 
+  if ((loom_int32_t)(bottom + 1 - wq->peak) > 0)
+    wq->peak = bottom + 1;
+
   return (bottom - top + 1);
 }
 
-/// Tries to pop a task from @wq.
-static loom_task_t *loom_work_queue_pop(loom_work_queue_t *wq) {
-  const loom_uint32_t bottom = loom_atomic_decr_u32(&wq->bottom);
+/// \brief Makes room to stage tasks in @wq, @staged of which are already.
+///
+/// \details Staged tasks are written past `bottom` but not published, so
+/// thieves can't observe them. See `loom_work_queue_stage` and
+/// `loom_work_queue_publish`.
+///
+/// \returns The number of tasks that can be staged before making more room.
+///
+static loom_uint32_t loom_work_queue_make_room(loom_work_queue_t *wq,
+                                               loom_uint32_t staged) {
+  const loom_uint32_t bottom = loom_atomic_load_u32(&wq->bottom) + staged;
   const loom_uint32_t top = loom_atomic_load_u32(&wq->top);
 
-  if (top <= bottom) {
-    // Non-empty.
-    loom_task_t *task =
-      (loom_task_t *)loom_atomic_load_ptr((void *volatile *)&wq->tasks[bottom % wq->size]);
+  loom_work_queue_buffer_t *buffer = wq->buffer;
 
-    if (top != bottom)
-      // Still more than one task left in the queue.
-      return task;
+  if ((bottom - top) >= buffer->size)
+    // Staged tasks are copied along with queued ones.
+    buffer = loom_work_queue_grow(wq, top, bottom);
 
-    // This is the last task in the queue. Potential race against steal.
-    if (loom_atomic_cmp_and_xchg_u32(&wq->top, top, top + 1) != top)
-      task = NULL;
+  // Thieves only ever advance `top`, so this is conservative.
+  return buffer->size - (bottom - top);
+}
 
-    loom_atomic_store_u32(&wq->bottom, top + 1);
+/// Writes @task into @wq, @staged slots past `bottom`, without publishing it.
+///
+/// \warning Room must have been made for it by `loom_work_queue_make_room`.
+///
+static LOOM_INLINE void loom_work_queue_stage(loom_work_queue_t *wq,
+                                              loom_uint32_t staged,
+                                              loom_task_t *task) {
+  loom_work_queue_buffer_t *buffer = wq->buffer;
+  buffer->tasks[(wq->bottom + staged) & buffer->size_minus_one] = task;
+}
 
-    return task;
+/// Publishes @n staged tasks at once, returning the new depth of @wq.
+static loom_uint32_t loom_work_queue_publish(loom_work_queue_t *wq,
+                                             loom_uint32_t n) {
+  const loom_uint32_t bottom = loom_atomic_load_u32(&wq->bottom);
+  const loom_uint32_t top = loom_atomic_load_u32(&wq->top);
+
+  // Ensure tasks are published prior to advertising.
+  loom_atomic_barrier();
+
+  loom_atomic_store_u32(&wq->bottom, bottom + n);
+
+  if ((loom_int32_t)(bottom + n - wq->peak) > 0)
+    wq->peak = bottom + n;
+
+  return (bottom - top + n);
+}
+
+/// Returns the number of tasks, starting at @top, that a thief could be part
+/// way through stealing from @wq.
+///
+/// \details A thief steals up to half of the tasks it observed, so we need to
+/// know the deepest @wq has been since `top` took on its current value. We
+/// can't know exactly when that was, but it was sometime after we last loaded
+/// `top`, so we track the deepest @wq has been between loads.
+///
+/// Thieves that load `top` after we have decremented `bottom` observe that
+/// decrement, and can't reach the task being popped.
+///
+/// \warning Only call from the producer thread, after decrementing `bottom`.
+///
+static loom_uint32_t loom_work_queue_reach(loom_work_queue_t *wq,
+                                           loom_uint32_t top,
+                                           loom_uint32_t bottom) {
+  if (top != wq->observed) {
+    // Advanced since we last loaded it.
+    wq->observed = top;
+    wq->watermark = wq->peak;
   } else {
-    // Empty.
-    loom_atomic_store_u32(&wq->bottom, top);
-    return NULL;
+    if ((loom_int32_t)(wq->peak - wq->watermark) > 0)
+      wq->watermark = wq->peak;
+  }
+
+  wq->peak = bottom;
+
+  const loom_int32_t depth = (loom_int32_t)(wq->watermark - top);
+
+  if (depth <= 1)
+    return 1;
+
+  const loom_uint32_t half = depth - depth / 2;
+
+  return (half < LOOM_STEAL_LIMIT) ? half : LOOM_STEAL_LIMIT;
+}
+
+/// \brief Tries to pop a task from @wq.
+///
+/// \returns `NULL` only if @wq is empty.
+///
+static loom_task_t *loom_work_queue_pop(loom_work_queue_t *wq) {
+  while (1) {
+    const loom_uint32_t bottom = loom_atomic_decr_u32(&wq->bottom);
+    const loom_uint32_t top = loom_atomic_load_u32(&wq->top);
+
+    // Indices are free to wrap, so we compare by signed distance.
+    const loom_int32_t depth = (loom_int32_t)(bottom - top);
+
+    if (depth < 0) {
+      // Empty.
+      loom_atomic_store_u32(&wq->bottom, top);
+      return NULL;
+    }
+
+    loom_work_queue_buffer_t *buffer = wq->buffer;
+
+    if ((loom_uint32_t)depth >= loom_work_queue_reach(wq, top, bottom + 1))
+      // Out of reach of thieves.
+      return (loom_task_t *)loom_atomic_load_ptr((void *volatile *)&buffer->tasks[bottom & buffer->size_minus_one]);
+
+    // Potential race against steal, so we race for the oldest task rather
+    // than the newest. If this is the last task in the queue, they're one and
+    // the same.
+    loom_task_t *task =
+      (loom_task_t *)loom_atomic_load_ptr((void *volatile *)&buffer->tasks[top & buffer->size_minus_one]);
+
+    const loom_bool_t won = (loom_atomic_cmp_and_xchg_u32(&wq->top, top, top + 1) == top);
+
+    // Thieves never steal beyond the bottom they observed, so this is never
+    // behind `top`.
+    loom_atomic_store_u32(&wq->bottom, bottom + 1);
+
+    if (won)
+      return task;
+
+    // Lost to a thief, but tasks may remain. We'll find out when we retry.
   }
 }
 
-/// Tries to steal a task from @wq.
-static loom_task_t *loom_work_queue_steal(loom_work_queue_t *wq) {
+/// \brief Tries to steal up to half of the tasks in @wq.
+///
+/// \details The oldest stolen task is returned, and the rest are pushed into
+/// @into, which must be owned by the calling thread. If @into is `NULL` at
+/// most one task is stolen.
+///
+/// \param stolen Set to the number of tasks stolen.
+///
+static loom_task_t *loom_work_queue_steal(loom_work_queue_t *wq,
+                                          loom_work_queue_t *into,
+                                          loom_uint32_t *stolen) {
+  *stolen = 0;
+
   const loom_uint32_t top = loom_atomic_load_u32(&wq->top);
 
   loom_atomic_acquire();
 
   const loom_uint32_t bottom = loom_atomic_load_u32(&wq->bottom);
 
-  if (top < bottom) {
+  const loom_int32_t depth = (loom_int32_t)(bottom - top);
+
+  if (depth > 0) {
     // Non-empty.
-    loom_task_t *task =
-      (loom_task_t *)loom_atomic_load_ptr((void *volatile *)&wq->tasks[top % wq->size]);
+    loom_uint32_t n = into ? (depth - depth / 2) : 1;
+
+    if (n > LOOM_STEAL_LIMIT)
+      n = LOOM_STEAL_LIMIT;
+
+    loom_atomic_acquire();
+
+    // Must be loaded after `bottom` so we never see a buffer older than the
+    // tasks we're about to steal.
+    loom_work_queue_buffer_t *buffer =
+      (loom_work_queue_buffer_t *)loom_atomic_load_ptr((void *volatile *)&wq->buffer);
+
+    loom_task_t *tasks[LOOM_STEAL_LIMIT];
 
-    if (loom_atomic_cmp_and_xchg_u32(&wq->top, top, top + 1) != top)
+    for (loom_uint32_t task = 0; task < n; ++task)
+      tasks[task] = (loom_task_t *)loom_atomic_load_ptr((void *volatile *)&buffer->tasks[(top + task) & buffer->size_minus_one]);
+
+    if (loom_atomic_cmp_and_xchg_u32(&wq->top, top, top + n) != top)
       // Lost to a pop or another steal.
       return NULL;
 
-    return task;
+    // Queue in reverse so we work through them oldest first, like we would
+    // have had we stolen one at a time.
+    for (loom_uint32_t task = n - 1; task > 0; --task)
+      loom_work_queue_push(into, tasks[task]);
+
+    *stolen = n;
+
+    return tasks[0];
   } else {
     // Empty.
     return NULL;
@@ -156,795 +422,3317 @@ static loom_task_t *loom_work_queue_steal(loom_work_queue_t *wq) {
 static loom_uint32_t loom_work_queue_depth(loom_work_queue_t *wq) {
   const loom_uint32_t bottom = loom_atomic_load_u32(&wq->bottom);
   const loom_uint32_t top = loom_atomic_load_u32(&wq->top);
-  return (bottom - top);
+  const loom_int32_t depth = (loom_int32_t)(bottom - top);
+  // Transiently negative while popping the last task.
+  return (depth > 0) ? depth : 0;
 }
 
 /// Returns true if @wq is empty.
 static loom_bool_t loom_work_queue_is_empty(loom_work_queue_t *wq) {
   const loom_uint32_t bottom = loom_atomic_load_u32(&wq->bottom);
   const loom_uint32_t top = loom_atomic_load_u32(&wq->top);
-  return (bottom == top);
+  return ((loom_int32_t)(bottom - top) <= 0);
 }
 
-typedef struct loom_free_list {
-  loom_uint32_t next;
-  loom_uint32_t entries[0];
-} loom_free_list_t;
+typedef struct loom_injection_queue_cell {
+  loom_uint32_t sequence;
+  loom_task_t *task;
+} loom_injection_queue_cell_t;
 
-static loom_free_list_t *loom_free_list_alloc(loom_size_t size) {
-  loom_free_list_t *fl =
-    (loom_free_list_t *)calloc(size + 1, sizeof(loom_uint32_t));
+/// \brief A bounded, lock-free, multiple-producer, multiple-consumer queue of
+/// tasks.
+///
+/// \details Used to submit tasks from threads that don't have a work queue of
+/// their own, i.e. any thread other than the main thread or a worker.
+///
+/// This is an implementation of the bounded queue described by Dmitry Vyukov
+/// on 1024cores. Each cell carries a sequence number that tells producers and
+/// consumers whether it is ready to be written or read, so contention is
+/// limited to a single compare-and-exchange on either end.
+///
+typedef struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_injection_queue {
+  // Producers and consumers are kept apart to prevent false sharing.
+  loom_uint32_t enqueue;
+  LOOM_ALIGNED(LOOM_CACHE_LINE) loom_uint32_t dequeue;
 
-  fl->next = 0;
+  LOOM_ALIGNED(LOOM_CACHE_LINE) loom_uint32_t size;
+  loom_uint32_t size_minus_one;
 
-  for (unsigned slot = 0; slot < (size - 1); ++slot)
-    fl->entries[slot] = slot + 1;
+  loom_injection_queue_cell_t *cells;
+} loom_injection_queue_t;
 
-  fl->entries[size - 1] = 0xffffffff;
+// Smallest injection queue we'll allocate.
+#define LOOM_MINIMUM_INJECTION_QUEUE_SIZE 256
 
-  return fl;
+static loom_injection_queue_t *loom_injection_queue_create(loom_size_t size) {
+  loom_injection_queue_t *iq =
+    (loom_injection_queue_t *)loom_memory_alloc(sizeof(loom_injection_queue_t), LOOM_CACHE_LINE);
+
+  // Round up to a power of two.
+  loom_uint32_t rounded = LOOM_MINIMUM_INJECTION_QUEUE_SIZE;
+  while (rounded < size)
+    rounded <<= 1;
+
+  iq->enqueue = iq->dequeue = 0;
+
+  iq->size = rounded;
+  iq->size_minus_one = rounded - 1;
+
+  iq->cells =
+    (loom_injection_queue_cell_t *)calloc(rounded, sizeof(loom_injection_queue_cell_t));
+
+  for (loom_uint32_t cell = 0; cell < rounded; ++cell)
+    iq->cells[cell].sequence = cell;
+
+  return iq;
 }
 
-static void loom_free_list_free(loom_free_list_t *fl) {
-  free((void *)fl);
+static void loom_injection_queue_destroy(loom_injection_queue_t *iq) {
+  free((void *)iq->cells);
+  loom_memory_free((void *)iq);
 }
 
-static void loom_free_list_push(loom_free_list_t *fl, loom_uint32_t entry) {
+/// Tries to enqueue @task into @iq, returning false if @iq is full.
+static loom_bool_t loom_injection_queue_enqueue(loom_injection_queue_t *iq,
+                                               loom_task_t *task) {
+  loom_uint32_t position = loom_atomic_load_u32(&iq->enqueue);
+
   while (1) {
-    const loom_uint32_t prev = loom_atomic_load_u32(&fl->next);
+    loom_injection_queue_cell_t *cell = &iq->cells[position & iq->size_minus_one];
 
-    loom_atomic_store_u32(&fl->entries[entry], prev);
+    const loom_uint32_t sequence = loom_atomic_load_u32(&cell->sequence);
+    const loom_int32_t difference = (loom_int32_t)(sequence - position);
 
-    if (loom_atomic_cmp_and_xchg_u32(&fl->next, prev, entry) != prev)
-      // Retry.
-      continue;
+    if (difference == 0) {
+      // Ready to be written, if we get to it first.
+      const loom_uint32_t claimed =
+        loom_atomic_cmp_and_xchg_u32(&iq->enqueue, position, position + 1);
 
-    return;
-  }
-}
+      if (claimed == position) {
+        cell->task = task;
 
-static loom_uint32_t loom_free_list_pop(loom_free_list_t *fl) {
-  while (1) {
-    const loom_uint32_t entry = loom_atomic_load_u32(&fl->next);
-    const loom_uint32_t next  = loom_atomic_load_u32(&fl->entries[entry]);
+        // Ensure task is published prior to advertising.
+        loom_atomic_release();
 
-    if (loom_atomic_cmp_and_xchg_u32(&fl->next, entry, next) != entry)
-      // Retry.
-      continue;
+        loom_atomic_store_u32(&cell->sequence, position + 1);
 
-    loom_assert_debug(entry != 0xffffffff);
+        return true;
+      }
 
-    return entry;
+      // Lost to another producer.
+      position = claimed;
+    } else if (difference < 0) {
+      // Full.
+      return false;
+    } else {
+      // Another producer got here first.
+      position = loom_atomic_load_u32(&iq->enqueue);
+    }
   }
 }
 
-typedef struct loom_task_pool {
-  loom_size_t size;
-  loom_uint32_t id;
-  loom_task_t *tasks;
-  loom_free_list_t *freelist;
-} loom_task_pool_t;
+/// Tries to dequeue a task from @iq.
+static loom_task_t *loom_injection_queue_dequeue(loom_injection_queue_t *iq) {
+  loom_uint32_t position = loom_atomic_load_u32(&iq->dequeue);
 
-static loom_task_pool_t *loom_task_pool_create(loom_size_t size) {
-  loom_task_pool_t *pool =
-    (loom_task_pool_t *)calloc(1, sizeof(loom_task_pool_t));
+  while (1) {
+    loom_injection_queue_cell_t *cell = &iq->cells[position & iq->size_minus_one];
 
-  pool->size = size;
+    const loom_uint32_t sequence = loom_atomic_load_u32(&cell->sequence);
+    const loom_int32_t difference = (loom_int32_t)(sequence - (position + 1));
 
-  pool->id = 0;
+    if (difference == 0) {
+      // Ready to be read, if we get to it first.
+      const loom_uint32_t claimed =
+        loom_atomic_cmp_and_xchg_u32(&iq->dequeue, position, position + 1);
 
-  pool->tasks = (loom_task_t *)calloc(size, sizeof(loom_task_t));
-  pool->freelist = loom_free_list_alloc(size);
+      if (claimed == position) {
+        loom_atomic_acquire();
 
-  return pool;
-}
+        loom_task_t *task = cell->task;
 
-static void loom_task_pool_destroy(loom_task_pool_t *pool) {
-  free((void *)pool->tasks);
+        // Ensure task is read prior to recycling.
+        loom_atomic_release();
 
-  loom_free_list_free(pool->freelist);
+        loom_atomic_store_u32(&cell->sequence, position + iq->size);
 
-  free((void *)pool);
+        return task;
+      }
+
+      // Lost to another consumer.
+      position = claimed;
+    } else if (difference < 0) {
+      // Empty.
+      return NULL;
+    } else {
+      // Another consumer got here first.
+      position = loom_atomic_load_u32(&iq->dequeue);
+    }
+  }
 }
 
-static loom_task_t *loom_task_pool_acquire(loom_task_pool_t *pool) {
-  const loom_uint32_t index = loom_free_list_pop(pool->freelist);
-  loom_task_t *task = &pool->tasks[index];
-  task->id = loom_atomic_incr_u32(&pool->id);
-  return task;
+/// Returns true if @iq is empty.
+/// \warning May change after calling.
+static loom_bool_t loom_injection_queue_is_empty(loom_injection_queue_t *iq) {
+  const loom_uint32_t dequeue = loom_atomic_load_u32(&iq->dequeue);
+  const loom_uint32_t enqueue = loom_atomic_load_u32(&iq->enqueue);
+  return ((loom_int32_t)(enqueue - dequeue) <= 0);
 }
 
-static void loom_task_pool_return(loom_task_pool_t *pool,
-                                  loom_task_t *task) {
-  const loom_uint32_t index = task - pool->tasks;
-  loom_free_list_push(pool->freelist, index);
+// Marks the end of a free list.
+#define LOOM_FREE_LIST_END 0xffffffff
+
+/// \def LOOM_POOL_CHUNKS
+/// \brief Maximum number of chunks a pool can grow to.
+#define LOOM_POOL_CHUNKS 32
+
+// Maps @index to the chunk it resides in, given the base-two logarithm of the
+// number of entries in the first chunk. Each chunk is twice the size of the
+// last, so the first index in chunk `n` is `((1 << n) - 1) << shift`.
+static LOOM_INLINE loom_uint32_t loom_chunk_of(loom_uint32_t shift,
+                                               loom_uint32_t index,
+                                               loom_uint32_t *offset) {
+  const loom_uint32_t chunk = 31 - loom_clz_u32((index >> shift) + 1);
+  *offset = index - (((1ul << chunk) - 1) << shift);
+  return chunk;
 }
 
-typedef struct loom_permit_pool {
-  loom_size_t size;
-  loom_permit_t *permits;
-  loom_free_list_t *freelist;
-} loom_permit_pool_t;
+/// \brief A lock-free stack of free entries, linked by index.
+///
+/// \details On x86_64 the head is tagged with a counter that's incremented on
+/// every change, preventing ABA when popping. This also lets us pop a batch of
+/// entries safely, as any change to the list while we're walking it causes our
+/// exchange to fail.
+///
+/// Links are stored in chunks that mirror those of the owning pool.
+///
+typedef struct loom_free_list {
+  loom_native_t next;
 
-static loom_permit_pool_t *loom_permit_pool_create(loom_size_t size) {
-  loom_permit_pool_t *pool =
-    (loom_permit_pool_t *)calloc(1, sizeof(loom_permit_pool_t));
+  loom_uint32_t shift;
+  loom_uint32_t flags;
 
-  pool->size = size;
+  loom_uint32_t *links[LOOM_POOL_CHUNKS];
+} loom_free_list_t;
 
-  pool->permits = (loom_permit_t *)calloc(size, sizeof(loom_permit_t));
-  pool->freelist = loom_free_list_alloc(size);
+// Index of the first free entry, given a (possibly tagged) head.
+static loom_uint32_t loom_free_list_head_to_index(loom_native_t head) {
+  return (loom_uint32_t)(head & 0xffffffff);
+}
 
-  return pool;
+// Retags @head to point to @index.
+static loom_native_t loom_free_list_retag(loom_native_t head, loom_uint32_t index) {
+#if LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86
+  (void)head;
+  return index;
+#elif LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64
+  return (((head >> 32) + 1) << 32) | index;
+#endif
 }
 
-static void loom_permit_pool_destroy(loom_permit_pool_t *pool) {
-  free((void *)pool->permits);
+// Link from @entry to the next free entry.
+static LOOM_INLINE loom_uint32_t *loom_free_list_link(loom_free_list_t *fl,
+                                                      loom_uint32_t entry) {
+  loom_uint32_t offset;
+  const loom_uint32_t chunk = loom_chunk_of(fl->shift, entry, &offset);
+  return &fl->links[chunk][offset];
+}
 
-  loom_free_list_free(pool->freelist);
+static loom_free_list_t *loom_free_list_alloc(loom_uint32_t shift,
+                                              loom_uint32_t flags) {
+  loom_free_list_t *fl =
+    (loom_free_list_t *)calloc(1, sizeof(loom_free_list_t));
 
-  free((void *)pool);
-}
+  fl->next = LOOM_FREE_LIST_END;
 
-static loom_permit_t *loom_permit_pool_acquire(loom_permit_pool_t *pool) {
-  const loom_uint32_t index = loom_free_list_pop(pool->freelist);
-  loom_permit_t *permit = &pool->permits[index];
-  return permit;
+  fl->shift = shift;
+  fl->flags = flags;
+
+  return fl;
 }
 
-static void loom_permit_pool_return(loom_permit_pool_t *pool,
-                                    loom_permit_t *permit) {
-  const loom_uint32_t index = (loom_size_t)(permit - pool->permits) / sizeof(loom_permit_t);
-  loom_free_list_push(pool->freelist, index);
+static void loom_free_list_free(loom_free_list_t *fl) {
+  for (unsigned chunk = 0; chunk < LOOM_POOL_CHUNKS; ++chunk)
+    if (fl->links[chunk])
+      loom_memory_unmap((void *)fl->links[chunk],
+                        ((loom_size_t)1 << (fl->shift + chunk)) * sizeof(loom_uint32_t),
+                        fl->flags);
+
+  free((void *)fl);
 }
 
-typedef struct loom_worker {
-  loom_uint32_t id;
+/// Pushes a chain of entries linked from @first to @last onto @fl.
+static void loom_free_list_push_n(loom_free_list_t *fl,
+                                  loom_uint32_t first,
+                                  loom_uint32_t last) {
+  while (1) {
+    const loom_native_t head = loom_atomic_load_native(&fl->next);
 
-  // Backing system thread.
-  loom_thread_t *thread;
+    loom_atomic_store_u32(loom_free_list_link(fl, last), loom_free_list_head_to_index(head));
 
-  // Non-zero when the worker should shutdown.
-  loom_uint32_t shutdown;
-} loom_worker_t;
+    if (loom_atomic_cmp_and_xchg_native(&fl->next, head, loom_free_list_retag(head, first)) != head)
+      // Retry.
+      continue;
 
-typedef struct loom_task_scheduler {
-  // Held whenever performing managerial tasks.
-  loom_lock_t *lock;
+    return;
+  }
+}
 
-  loom_prologue_t prologue;
-  loom_epilogue_t epilogue;
+static void loom_free_list_push(loom_free_list_t *fl, loom_uint32_t entry) {
+  loom_free_list_push_n(fl, entry, entry);
+}
 
-  loom_uint32_t n;
+/// Pops up to @n entries from @fl into @entries, returning the number popped.
+static loom_uint32_t loom_free_list_pop_n(loom_free_list_t *fl,
+                                          loom_uint32_t n,
+                                          loom_uint32_t *entries) {
+  while (1) {
+    const loom_native_t head = loom_atomic_load_native(&fl->next);
 
-  // We have a hard limit of 31 worker threads on x86 and 63 worker threads
-  // on x86_64. This isn't a limitation of the operating system, usually, but
-  // has to do with the cost of manipulating the various bitfields atomically.
-  loom_worker_t workers[LOOM_WORKER_LIMIT];
-  loom_work_queue_t *queues[LOOM_WORKER_LIMIT + 1];
+    loom_uint32_t entry = loom_free_list_head_to_index(head);
+    loom_uint32_t popped = 0;
 
-  // Bitset that tracks online workers.
-  loom_native_t online;
+    while ((popped < n) && (entry != LOOM_FREE_LIST_END)) {
+      entries[popped++] = entry;
+      entry = loom_atomic_load_u32(loom_free_list_link(fl, entry));
+    }
 
-  // Bitset used by workers to indicate excess work.
-  loom_native_t work;
+    if (popped == 0)
+      // Exhausted.
+      return 0;
 
-  // Raised whenever excess work is pushed to a work queue.
-  loom_event_t *work_to_steal;
+    if (loom_atomic_cmp_and_xchg_native(&fl->next, head, loom_free_list_retag(head, entry)) != head)
+      // Retry.
+      continue;
 
-  // Whenever work is pushed to the main thread's work queue `work_to_steal`
-  // should be signaled, regardless of of queue depth.
-  loom_bool_t always_steal_from_main_thread;
+    return popped;
+  }
+}
 
-  // Raised while one or more workers has an unhandled message.
-  loom_event_t *message;
+/// Links @chunk, which must be the most recently added chunk, into @fl.
+static void loom_free_list_grow(loom_free_list_t *fl, loom_uint32_t chunk) {
+  const loom_uint32_t size = 1ul << (fl->shift + chunk);
+  const loom_uint32_t first = ((1ul << chunk) - 1) << fl->shift;
 
-  loom_task_pool_t *tasks;
-  loom_permit_pool_t *permits;
+  loom_uint32_t *links =
+    (loom_uint32_t *)loom_memory_map(size * sizeof(loom_uint32_t), fl->flags, LOOM_MEMORY_ANY_NODE);
 
-  // Work queues are lazily initialized.
-  loom_size_t size_of_each_work_queue;
-} loom_task_scheduler_t;
+  for (loom_uint32_t link = 0; link < (size - 1); ++link)
+    links[link] = first + link + 1;
 
-// We provide a default prologue and epilogue so we can unconditionally call.
-static void default_prologue_and_epilogue(const loom_task_t *task, void *data) {
-  (void)task;
-  (void)data;
+  // Published by the exchange when pushed.
+  fl->links[chunk] = links;
+
+  loom_free_list_push_n(fl, first, first + size - 1);
 }
 
-static loom_task_scheduler_t *loom_task_scheduler_create(loom_size_t tasks,
-                                                         loom_size_t permits,
-                                                         loom_size_t queue) {
-  loom_task_scheduler_t *task_scheduler =
-    (loom_task_scheduler_t *)calloc(1, sizeof(loom_task_scheduler_t));
+/// \brief A pool of fixed-size entries, that grows on demand.
+///
+/// \details Pools grow by appending chunks, each twice the size of the last.
+/// Chunks are never moved nor freed until the pool is destroyed, so pointers
+/// to entries remain valid.
+///
+/// Entries can have a shadow, a parallel entry allocated alongside it, to keep
+/// rarely accessed data out of the entry's cache lines.
+///
+typedef struct loom_pool {
+  loom_size_t size_of_each_entry;
+  loom_size_t size_of_each_shadow;
 
-  task_scheduler->lock = loom_lock_create();
+  // How to map chunks. See `loom_memory_map`.
+  loom_uint32_t flags;
 
-  task_scheduler->prologue.fn = &default_prologue_and_epilogue;
-  task_scheduler->epilogue.fn = &default_prologue_and_epilogue;
+  // Base-two logarithm of the number of entries in the first chunk.
+  loom_uint32_t shift;
 
-  task_scheduler->n = 0;
+  // Number of chunks allocated so far.
+  loom_uint32_t chunks;
 
-  task_scheduler->queues[0] = loom_work_queue_create(queue);
+  loom_uint8_t *entries[LOOM_POOL_CHUNKS];
+  loom_uint8_t *shadows[LOOM_POOL_CHUNKS];
 
-  for (unsigned worker = 0; worker < LOOM_WORKER_LIMIT; ++worker) {
-    task_scheduler->workers[worker].id = worker + 1;
-    task_scheduler->workers[worker].thread = NULL;
-    task_scheduler->workers[worker].shutdown = 0;
+  // Held while growing.
+  loom_lock_t *lock;
 
-    // Work queues are lazily allocated.
-    task_scheduler->queues[worker + 1] = NULL;
-  }
+  loom_free_list_t *freelist;
+} loom_pool_t;
 
-  task_scheduler->online = 1;
-  task_scheduler->work   = 0;
+static void loom_pool_grow(loom_pool_t *pool, loom_uint32_t observed);
 
-  task_scheduler->work_to_steal = loom_event_create(false);
+static void loom_pool_init(loom_pool_t *pool,
+                           loom_size_t size_of_each_entry,
+                           loom_size_t size_of_each_shadow,
+                           loom_size_t size,
+                           loom_uint32_t flags) {
+  pool->size_of_each_entry = size_of_each_entry;
+  pool->size_of_each_shadow = size_of_each_shadow;
 
-  task_scheduler->message = loom_event_create(true);
+  pool->flags = flags;
 
-  task_scheduler->tasks = loom_task_pool_create(tasks);
-  task_scheduler->permits = loom_permit_pool_create(permits);
+  // Round up to a power of two.
+  pool->shift = 0;
+  while ((1ul << pool->shift) < size)
+    pool->shift += 1;
 
-  task_scheduler->size_of_each_work_queue = queue;
+  pool->chunks = 0;
 
-  return task_scheduler;
+  pool->lock = loom_lock_create();
+
+  pool->freelist = loom_free_list_alloc(pool->shift, flags);
+
+  loom_pool_grow(pool, 0);
 }
 
-static void loom_task_scheduler_destroy(loom_task_scheduler_t *task_scheduler) {
-  loom_lock_destroy(task_scheduler->lock);
+static void loom_pool_deinit(loom_pool_t *pool) {
+  for (unsigned chunk = 0; chunk < pool->chunks; ++chunk) {
+    const loom_size_t size = (loom_size_t)1 << (pool->shift + chunk);
 
-  for (unsigned worker = 0; worker < LOOM_WORKER_LIMIT; ++worker)
-    if (task_scheduler->queues[worker])
-      loom_work_queue_destroy(task_scheduler->queues[worker]);
+    loom_memory_unmap((void *)pool->entries[chunk], size * pool->size_of_each_entry, pool->flags);
 
-  loom_event_destroy(task_scheduler->work_to_steal);
+    if (pool->shadows[chunk])
+      loom_memory_unmap((void *)pool->shadows[chunk], size * pool->size_of_each_shadow, pool->flags);
+  }
 
-  loom_event_destroy(task_scheduler->message);
+  loom_lock_destroy(pool->lock);
 
-  loom_task_pool_destroy(task_scheduler->tasks);
+  loom_free_list_free(pool->freelist);
+}
+
+/// Appends a chunk to @pool, unless another thread already has since @pool
+/// had @observed chunks.
+static void loom_pool_grow(loom_pool_t *pool, loom_uint32_t observed) {
+  loom_lock_acquire(pool->lock);
+
+  const loom_uint32_t chunk = pool->chunks;
+
+  if (chunk == observed) {
+    // Indices must not reach `LOOM_FREE_LIST_END`.
+    loom_assert_debug((((2ull << chunk) - 1) << pool->shift) < LOOM_FREE_LIST_END);
+
+    const loom_size_t size = (loom_size_t)1 << (pool->shift + chunk);
+
+    // Mappings are page aligned, so entries are cache-line aligned.
+    pool->entries[chunk] =
+      (loom_uint8_t *)loom_memory_map(size * pool->size_of_each_entry, pool->flags, LOOM_MEMORY_ANY_NODE);
+
+    if (pool->size_of_each_shadow)
+      pool->shadows[chunk] =
+        (loom_uint8_t *)loom_memory_map(size * pool->size_of_each_shadow, pool->flags, LOOM_MEMORY_ANY_NODE);
+
+    // Ensure chunk is published prior to its entries becoming available.
+    loom_atomic_barrier();
+
+    loom_atomic_store_u32(&pool->chunks, chunk + 1);
+
+    loom_free_list_grow(pool->freelist, chunk);
+  }
+
+  loom_lock_release(pool->lock);
+}
+
+/// Pops up to @n free entries from @pool into @entries, growing @pool if
+/// exhausted. Returns the number popped, which is always non-zero.
+static loom_uint32_t loom_pool_pop_n(loom_pool_t *pool,
+                                     loom_uint32_t n,
+                                     loom_uint32_t *entries) {
+  while (1) {
+    const loom_uint32_t observed = loom_atomic_load_u32(&pool->chunks);
+
+    if (const loom_uint32_t popped = loom_free_list_pop_n(pool->freelist, n, entries))
+      return popped;
+
+    loom_pool_grow(pool, observed);
+  }
+}
+
+static LOOM_INLINE void *loom_pool_entry(const loom_pool_t *pool,
+                                         loom_uint32_t index,
+                                         loom_size_t size_of_each_entry) {
+  loom_uint32_t offset;
+  const loom_uint32_t chunk = loom_chunk_of(pool->shift, index, &offset);
+  return (void *)&pool->entries[chunk][offset * size_of_each_entry];
+}
+
+static LOOM_INLINE void *loom_pool_shadow(const loom_pool_t *pool,
+                                          loom_uint32_t index,
+                                          loom_size_t size_of_each_shadow) {
+  loom_uint32_t offset;
+  const loom_uint32_t chunk = loom_chunk_of(pool->shift, index, &offset);
+  return (void *)&pool->shadows[chunk][offset * size_of_each_shadow];
+}
+
+/// \def LOOM_MAGAZINE_BATCH
+/// \brief Number of entries moved between a magazine and a pool at once.
+#ifndef LOOM_MAGAZINE_BATCH
+  #define LOOM_MAGAZINE_BATCH 32
+#endif
+
+/// \brief A thread-local cache of free entries.
+///
+/// \details Magazines are refilled from, and flushed to, a pool in batches. A
+/// magazine holds up to two batches so that a thread alternating between
+/// acquiring and returning doesn't thrash the pool's free list.
+///
+typedef struct loom_magazine {
+  loom_uint32_t count;
+  loom_uint32_t entries[2 * LOOM_MAGAZINE_BATCH];
+} loom_magazine_t;
+
+static loom_uint32_t loom_magazine_acquire(loom_magazine_t *magazine,
+                                           loom_pool_t *pool) {
+  if (magazine->count == 0)
+    magazine->count = loom_pool_pop_n(pool, LOOM_MAGAZINE_BATCH, &magazine->entries[0]);
+
+  return magazine->entries[--magazine->count];
+}
+
+static void loom_magazine_return(loom_magazine_t *magazine,
+                                 loom_pool_t *pool,
+                                 loom_uint32_t entry) {
+  if (magazine->count == 2 * LOOM_MAGAZINE_BATCH) {
+    // Full, so flush the oldest batch.
+    const loom_uint32_t *batch = &magazine->entries[0];
+
+    for (unsigned slot = 0; slot < (LOOM_MAGAZINE_BATCH - 1); ++slot)
+      *loom_free_list_link(pool->freelist, batch[slot]) = batch[slot + 1];
+
+    loom_free_list_push_n(pool->freelist, batch[0], batch[LOOM_MAGAZINE_BATCH - 1]);
+
+    memmove((void *)&magazine->entries[0],
+            (const void *)&magazine->entries[LOOM_MAGAZINE_BATCH],
+            LOOM_MAGAZINE_BATCH * sizeof(loom_uint32_t));
+
+    magazine->count -= LOOM_MAGAZINE_BATCH;
+  }
+
+  magazine->entries[magazine->count++] = entry;
+}
+
+static loom_uint32_t loom_pool_acquire(loom_pool_t *pool,
+                                       loom_magazine_t *magazine) {
+  if (magazine)
+    return loom_magazine_acquire(magazine, pool);
+
+  loom_uint32_t entry;
+  loom_pool_pop_n(pool, 1, &entry);
+  return entry;
+}
+
+static void loom_pool_return(loom_pool_t *pool,
+                             loom_magazine_t *magazine,
+                             loom_uint32_t entry) {
+  if (magazine)
+    loom_magazine_return(magazine, pool, entry);
+  else
+    loom_free_list_push(pool->freelist, entry);
+}
+
+// Thread-local caches of free tasks and permits, and a block of reserved task
+// identifiers, so that most acquires and returns only touch memory local to
+// the calling thread.
+typedef struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_cache {
+  loom_magazine_t tasks;
+  loom_magazine_t permits;
+
+  loom_uint32_t id;
+  loom_uint32_t ids;
+} loom_cache_t;
+
+/// \brief Bookkeeping for a task that isn't needed to dispatch it.
+///
+/// \details Kept apart from tasks, so that only tasks that permit others
+/// touch it, and only while being described or after completing.
+///
+typedef struct loom_task_cold {
+  /// Number of tasks blocked by this task.
+  loom_uint32_t blocks;
+
+  /// Last permit, so that permits can be appended in constant time.
+  loom_permit_t *tail;
+
+  /// The first few permits, so that most tasks don't need to acquire any.
+  loom_permit_t permits[LOOM_EMBEDDED_PERMITS];
+} loom_task_cold_t;
+
+// Everything needed to dispatch a task must fit in its first cache line.
+static_assert(offsetof(loom_task_t, payload) <= LOOM_CACHE_LINE,
+              "Dispatch-critical fields of `loom_task_t` exceed a cache line!");
+
+typedef struct loom_task_pool {
+  loom_pool_t pool;
+  loom_uint32_t id;
+} loom_task_pool_t;
+
+static loom_task_pool_t *loom_task_pool_create(loom_size_t size,
+                                                loom_uint32_t flags) {
+  loom_task_pool_t *pool =
+    (loom_task_pool_t *)calloc(1, sizeof(loom_task_pool_t));
+
+  loom_pool_init(&pool->pool, sizeof(loom_task_t), sizeof(loom_task_cold_t), size, flags);
+
+  pool->id = 0;
+
+  return pool;
+}
+
+static void loom_task_pool_destroy(loom_task_pool_t *pool) {
+  loom_pool_deinit(&pool->pool);
+
+  free((void *)pool);
+}
+
+static loom_task_t *loom_task_pool_lookup(loom_task_pool_t *pool,
+                                          loom_uint32_t index) {
+  return (loom_task_t *)loom_pool_entry(&pool->pool, index, sizeof(loom_task_t));
+}
+
+static loom_task_cold_t *loom_task_pool_cold(loom_task_pool_t *pool,
+                                             const loom_task_t *task) {
+  return (loom_task_cold_t *)loom_pool_shadow(&pool->pool, task->index, sizeof(loom_task_cold_t));
+}
+
+static loom_task_t *loom_task_pool_acquire(loom_task_pool_t *pool,
+                                           loom_cache_t *cache) {
+  const loom_uint32_t index =
+    loom_pool_acquire(&pool->pool, cache ? &cache->tasks : NULL);
+
+  loom_task_t *task = loom_task_pool_lookup(pool, index);
+
+  task->index = index;
+
+  if (cache == NULL) {
+    task->id = loom_atomic_incr_u32(&pool->id);
+    return task;
+  }
+
+  if (cache->ids == 0) {
+    // Reserve another block of identifiers.
+    cache->id = loom_atomic_fetch_and_add_u32(&pool->id, LOOM_MAGAZINE_BATCH);
+    cache->ids = LOOM_MAGAZINE_BATCH;
+  }
+
+  task->id = ++cache->id;
+  cache->ids -= 1;
+
+  return task;
+}
+
+/// Acquires @n tasks at once, where @n is at most `2 * LOOM_MAGAZINE_BATCH`.
+/// Drains the magazine first, then pops whatever else is needed off the free
+/// list, usually in a single operation. Identifiers are reserved in one go.
+static void loom_task_pool_acquire_n(loom_task_pool_t *pool,
+                                     loom_cache_t *cache,
+                                     loom_uint32_t n,
+                                     loom_uint32_t *indices,
+                                     loom_uint32_t *first_id) {
+  loom_assert_debug(n <= 2 * LOOM_MAGAZINE_BATCH);
+
+  loom_uint32_t acquired = 0;
+
+  if (cache) {
+    loom_magazine_t *magazine = &cache->tasks;
+
+    while ((acquired < n) && (magazine->count > 0))
+      indices[acquired++] = magazine->entries[--magazine->count];
+  }
+
+  while (acquired < n)
+    acquired += loom_pool_pop_n(&pool->pool, n - acquired, &indices[acquired]);
+
+  *first_id = loom_atomic_fetch_and_add_u32(&pool->id, n) + 1;
+}
+
+static void loom_task_pool_return(loom_task_pool_t *pool,
+                                  loom_cache_t *cache,
+                                  loom_task_t *task) {
+  loom_pool_return(&pool->pool, cache ? &cache->tasks : NULL, task->index);
+}
+
+// Permits acquired from the pool remember their index, so they can be
+// returned without searching for it. Embedded permits never are, so they
+// don't pay for it.
+typedef struct loom_pooled_permit {
+  loom_permit_t permit;
+  loom_uint32_t index;
+} loom_pooled_permit_t;
+
+typedef struct loom_permit_pool {
+  loom_pool_t pool;
+} loom_permit_pool_t;
+
+static loom_permit_t *loom_permit_pool_lookup(loom_permit_pool_t *pool,
+                                              loom_uint32_t index) {
+  loom_pooled_permit_t *pooled =
+    (loom_pooled_permit_t *)loom_pool_entry(&pool->pool, index, sizeof(loom_pooled_permit_t));
+
+  pooled->index = index;
+
+  return &pooled->permit;
+}
+
+static loom_permit_pool_t *loom_permit_pool_create(loom_size_t size,
+                                                    loom_uint32_t flags) {
+  loom_permit_pool_t *pool =
+    (loom_permit_pool_t *)calloc(1, sizeof(loom_permit_pool_t));
+
+  loom_pool_init(&pool->pool, sizeof(loom_pooled_permit_t), 0, size, flags);
+
+  return pool;
+}
+
+static void loom_permit_pool_destroy(loom_permit_pool_t *pool) {
+  loom_pool_deinit(&pool->pool);
+
+  free((void *)pool);
+}
+
+static loom_permit_t *loom_permit_pool_acquire(loom_permit_pool_t *pool,
+                                               loom_cache_t *cache) {
+  const loom_uint32_t index =
+    loom_pool_acquire(&pool->pool, cache ? &cache->permits : NULL);
+
+  return loom_permit_pool_lookup(pool, index);
+}
+
+/// Acquires up to @n permits from @pool at once, bypassing any magazine.
+/// Returns the number acquired, which is always non-zero.
+static loom_uint32_t loom_permit_pool_acquire_n(loom_permit_pool_t *pool,
+                                                loom_uint32_t n,
+                                                loom_permit_t **permits) {
+  loom_uint32_t indices[LOOM_MAGAZINE_BATCH];
+
+  if (n > LOOM_MAGAZINE_BATCH)
+    n = LOOM_MAGAZINE_BATCH;
+
+  const loom_uint32_t acquired = loom_pool_pop_n(&pool->pool, n, &indices[0]);
+
+  for (loom_uint32_t permit = 0; permit < acquired; ++permit)
+    permits[permit] = loom_permit_pool_lookup(pool, indices[permit]);
+
+  return acquired;
+}
+
+static void loom_permit_pool_return(loom_permit_pool_t *pool,
+                                    loom_cache_t *cache,
+                                    loom_permit_t *permit) {
+  const loom_uint32_t index = ((const loom_pooled_permit_t *)permit)->index;
+
+  loom_pool_return(&pool->pool, cache ? &cache->permits : NULL, index);
+}
+
+#if LOOM_FIBERS
+
+// We bound the number of fibers, rather than the memory backing them, as
+// stacks are only committed as they're touched.
+#define LOOM_DEFAULT_FIBERS 128
+#define LOOM_DEFAULT_FIBER_STACK (64 * 1024)
+
+enum loom_fiber_state {
+  LOOM_FIBER_RUNNING   = 0,
+  LOOM_FIBER_SUSPENDED = 1,
+  LOOM_FIBER_DONE      = 2
+};
+
+typedef struct loom_fiber {
+  loom_fiber_context_t context;
+
+  void *stack;
+
+  // Task running on this fiber.
+  loom_task_t *task;
+
+  // One of `loom_fiber_state`.
+  loom_uint32_t state;
+
+  // Counter the task is suspended waiting on, when suspended.
+  loom_counter_t *counter;
+
+  // Next free fiber.
+  struct loom_fiber *next;
+} loom_fiber_t;
+
+// Fibers are only acquired when fiber tasks are first scheduled, and
+// returned when they're completed, so a lock suffices.
+typedef struct loom_fiber_pool {
+  loom_lock_t *lock;
+
+  loom_fiber_t *free;
+
+  // Fibers are lazily given stacks, in order.
+  loom_fiber_t *fibers;
+  loom_size_t count;
+  loom_size_t limit;
+
+  loom_size_t size_of_each_stack;
+} loom_fiber_pool_t;
+
+static loom_fiber_pool_t *loom_fiber_pool_create(loom_size_t limit,
+                                                 loom_size_t size_of_each_stack) {
+  loom_fiber_pool_t *pool =
+    (loom_fiber_pool_t *)calloc(1, sizeof(loom_fiber_pool_t));
+
+  pool->lock = loom_lock_create();
+
+  pool->free = NULL;
+
+  pool->fibers = (loom_fiber_t *)calloc(limit, sizeof(loom_fiber_t));
+  pool->count = 0;
+  pool->limit = limit;
+
+  pool->size_of_each_stack = size_of_each_stack;
+
+  return pool;
+}
+
+static void loom_fiber_pool_destroy(loom_fiber_pool_t *pool) {
+  for (loom_size_t fiber = 0; fiber < pool->count; ++fiber)
+    loom_fiber_stack_free(pool->fibers[fiber].stack, pool->size_of_each_stack);
+
+  free((void *)pool->fibers);
+
+  loom_lock_destroy(pool->lock);
+
+  free((void *)pool);
+}
+
+// Returns NULL if every fiber is in use.
+static loom_fiber_t *loom_fiber_pool_acquire(loom_fiber_pool_t *pool) {
+  loom_lock_acquire(pool->lock);
+
+  loom_fiber_t *fiber = pool->free;
+
+  if (fiber) {
+    pool->free = fiber->next;
+  } else if (pool->count < pool->limit) {
+    fiber = &pool->fibers[pool->count];
+
+    fiber->stack = loom_fiber_stack_alloc(pool->size_of_each_stack);
+
+    if (fiber->stack)
+      pool->count += 1;
+    else
+      fiber = NULL;
+  }
+
+  loom_lock_release(pool->lock);
+
+  return fiber;
+}
+
+static void loom_fiber_pool_return(loom_fiber_pool_t *pool,
+                                   loom_fiber_t *fiber) {
+  loom_lock_acquire(pool->lock);
+
+  fiber->next = pool->free;
+  pool->free = fiber;
+
+  loom_lock_release(pool->lock);
+}
+
+#endif
+
+// Tasks are bucketed into priority classes, in order of precedence. Each
+// thread has a work queue per class.
+enum {
+  LOOM_PRIORITY_CRITICAL   = 0,
+  LOOM_PRIORITY_NORMAL     = 1,
+  LOOM_PRIORITY_BACKGROUND = 2,
+  LOOM_PRIORITIES          = 3
+};
+
+static unsigned loom_priority_of(const loom_task_t *task) {
+  if (task->flags & LOOM_TASK_CRITICAL)
+    return LOOM_PRIORITY_CRITICAL;
+  if (task->flags & LOOM_TASK_BACKGROUND)
+    return LOOM_PRIORITY_BACKGROUND;
+  return LOOM_PRIORITY_NORMAL;
+}
+
+// A bitset padded out to a cache line.
+typedef struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_bitset {
+  loom_native_t bits;
+} loom_bitset_t;
+
+// Each worker is given its own cache line, as `shutdown` is polled
+// continuously by the worker.
+typedef struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_worker {
+  loom_uint32_t id;
+
+  // Backing system thread.
+  loom_thread_t *thread;
+
+  // Non-zero when the worker should shutdown.
+  loom_uint32_t shutdown;
+
+  // Signaled to wake the worker while parked.
+  loom_event_t *parking;
+
+  // Exponential moving average of time spent idle, and the time we'll spin
+  // for derived from it, in nanoseconds.
+  loom_uint64_t gap;
+  loom_uint64_t budget;
+
+  // Only written by the worker, so other threads may read a stale value.
+  loom_idle_statistics_t statistics;
+} loom_worker_t;
+
+// Layout is important here. Read-mostly configuration is kept together, while
+// frequently written state is isolated in its own cache lines to prevent false
+// sharing between workers.
+typedef struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_task_scheduler {
+  loom_prologue_t prologue;
+  loom_epilogue_t epilogue;
+
+  // Whenever work is pushed to the main thread's work queue a worker should
+  // be woken, regardless of of queue depth.
+  loom_bool_t always_steal_from_main_thread;
+
+  loom_task_pool_t *tasks;
+  loom_permit_pool_t *permits;
+
+#if LOOM_FIBERS
+  loom_fiber_pool_t *fibers;
+#endif
+
+#if LOOM_IO_URING
+  // Ring that I/O tasks are submitted to, if io_uring is available.
+  loom_io_ring_t *io;
+
+  // Limits the number of operations in flight, so completions can never
+  // overflow the ring.
+  loom_uint32_t io_limit;
+#endif
+
+  // Tasks submitted by threads other than the main thread or a worker, per
+  // priority class.
+  loom_injection_queue_t *injected[LOOM_PRIORITIES];
+
+  // Work queues are lazily initialized, and grow on demand from this size.
+  loom_size_t size_of_each_work_queue;
+
+  // How to map pools and work queues. See `loom_memory_map`.
+  loom_uint32_t memory;
+
+  // Place each worker's work queues on its NUMA node.
+  loom_bool_t numa;
+
+  // Limits on time spent spinning and yielding, in nanoseconds.
+  loom_uint64_t spin;
+  loom_uint64_t yield;
+
+  loom_bool_t adaptive;
+
+  // We have a hard limit of 31 worker threads on x86 and 63 worker threads
+  // on x86_64. This isn't a limitation of the operating system, usually, but
+  // has to do with the cost of manipulating the various bitfields atomically.
+  loom_work_queue_t *queues[LOOM_WORKER_LIMIT + 1][LOOM_PRIORITIES];
+
+  // Held whenever performing managerial tasks.
+  LOOM_ALIGNED(LOOM_CACHE_LINE) loom_lock_t *lock;
+
+  loom_uint32_t n;
+
+  // Bitset that tracks online workers.
+  LOOM_ALIGNED(LOOM_CACHE_LINE) loom_native_t online;
+
+  // Bitsets used by workers to indicate excess work, per priority class.
+  loom_bitset_t work[LOOM_PRIORITIES];
+
+  // Bitset that tracks parked workers.
+  LOOM_ALIGNED(LOOM_CACHE_LINE) loom_native_t sleepers;
+
+  // Number of workers looking for work without having found any yet.
+  loom_uint32_t searching;
+
+#if LOOM_IO_URING
+  // Number of I/O tasks submitted but not yet completed.
+  LOOM_ALIGNED(LOOM_CACHE_LINE) loom_uint32_t io_in_flight;
+
+  // Set while a worker is blocked waiting on the ring, rather than parked.
+  loom_uint32_t io_waiter;
+#endif
+
+  loom_worker_t workers[LOOM_WORKER_LIMIT];
+
+  // Caches of free tasks and permits, one for the main thread and one for
+  // each worker.
+  loom_cache_t caches[LOOM_WORKER_LIMIT + 1];
+} loom_task_scheduler_t;
+
+// We provide a default prologue and epilogue so we can unconditionally call.
+static void default_prologue_and_epilogue(const loom_task_t *task, void *data) {
+  (void)task;
+  (void)data;
+}
+
+static loom_task_scheduler_t *loom_task_scheduler_create(loom_size_t tasks,
+                                                         loom_size_t permits,
+                                                         loom_size_t queue,
+                                                         loom_size_t injection,
+                                                         loom_uint32_t memory) {
+  loom_task_scheduler_t *task_scheduler =
+    (loom_task_scheduler_t *)loom_memory_alloc(sizeof(loom_task_scheduler_t), LOOM_CACHE_LINE);
+
+  task_scheduler->lock = loom_lock_create();
+
+  task_scheduler->prologue.fn = &default_prologue_and_epilogue;
+  task_scheduler->epilogue.fn = &default_prologue_and_epilogue;
+
+  task_scheduler->n = 0;
+
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+    task_scheduler->queues[0][priority] = loom_work_queue_create(queue, memory, LOOM_MEMORY_ANY_NODE);
+
+  for (unsigned worker = 0; worker < LOOM_WORKER_LIMIT; ++worker) {
+    task_scheduler->workers[worker].id = worker + 1;
+    task_scheduler->workers[worker].thread = NULL;
+    task_scheduler->workers[worker].shutdown = 0;
+
+    task_scheduler->workers[worker].parking = loom_event_create(false);
+
+    task_scheduler->workers[worker].gap = 0;
+    task_scheduler->workers[worker].budget = 0;
+
+    // Work queues are lazily allocated.
+    for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+      task_scheduler->queues[worker + 1][priority] = NULL;
+  }
+
+  task_scheduler->online = 1;
+
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+    task_scheduler->work[priority].bits = 0;
+
+  task_scheduler->sleepers = 0;
+  task_scheduler->searching = 0;
+
+#if LOOM_IO_URING
+  task_scheduler->io = NULL;
+  task_scheduler->io_limit = 0;
+  task_scheduler->io_in_flight = 0;
+  task_scheduler->io_waiter = 0;
+#endif
+
+  task_scheduler->tasks = loom_task_pool_create(tasks, memory);
+  task_scheduler->permits = loom_permit_pool_create(permits, memory);
+
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+    task_scheduler->injected[priority] = loom_injection_queue_create(injection);
+
+  task_scheduler->size_of_each_work_queue = queue;
+
+  task_scheduler->memory = memory;
+  task_scheduler->numa = false;
+
+  return task_scheduler;
+}
+
+static void loom_task_scheduler_destroy(loom_task_scheduler_t *task_scheduler) {
+  loom_lock_destroy(task_scheduler->lock);
+
+  for (unsigned worker = 0; worker < LOOM_WORKER_LIMIT; ++worker)
+    for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+      if (task_scheduler->queues[worker][priority])
+        loom_work_queue_destroy(task_scheduler->queues[worker][priority]);
+
+  for (unsigned worker = 0; worker < LOOM_WORKER_LIMIT; ++worker)
+    loom_event_destroy(task_scheduler->workers[worker].parking);
+
+  loom_task_pool_destroy(task_scheduler->tasks);
   loom_permit_pool_destroy(task_scheduler->permits);
 
-  free((void *)task_scheduler);
+#if LOOM_FIBERS
+  loom_fiber_pool_destroy(task_scheduler->fibers);
+#endif
+
+#if LOOM_IO_URING
+  if (task_scheduler->io)
+    loom_io_ring_destroy(task_scheduler->io);
+#endif
+
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+    loom_injection_queue_destroy(task_scheduler->injected[priority]);
+
+  loom_memory_free((void *)task_scheduler);
+}
+
+static loom_task_scheduler_t *S = NULL;
+
+// We use a thread-local pointer to track the appropriate queues. This makes
+// handling submissions much easier.
+static LOOM_THREAD_LOCAL loom_work_queue_t **Q = NULL;
+
+// We also track the index of the queue to simplify house keeping.
+static LOOM_THREAD_LOCAL loom_uint32_t q = 0;
+
+// Like queues, only the main thread and workers have caches. Other threads go
+// straight to the pools.
+static LOOM_THREAD_LOCAL loom_cache_t *C = NULL;
+
+// We maintain a pseduo-random number generator per-thread to reduce false
+// sharing, and implications of multi-threaded access.
+static LOOM_THREAD_LOCAL loom_prng_t *P = NULL;
+
+// Task being run by this thread, if any, so kernels can continue it.
+static LOOM_THREAD_LOCAL loom_task_t *T = NULL;
+
+#if LOOM_FIBERS
+// Fiber being run by this thread, if any.
+static LOOM_THREAD_LOCAL loom_fiber_t *F = NULL;
+
+// Context to return to when the fiber being run by this thread suspends or
+// completes.
+static LOOM_THREAD_LOCAL loom_fiber_context_t R = NULL;
+#endif
+
+static loom_task_t *loom_acquire_a_task(void) {
+  loom_task_t *task = loom_task_pool_acquire(S->tasks, C);
+  return task;
+}
+
+static void loom_return_a_task(loom_task_t *task) {
+  loom_task_pool_return(S->tasks, C, task);
+}
+
+// Links @permit after the last of @task's permits.
+static void loom_link_a_permit(loom_task_t *task,
+                               loom_task_cold_t *cold,
+                               loom_permit_t *permit) {
+  permit->next = NULL;
+
+  if (task->permits)
+    cold->tail->next = permit;
+  else
+    task->permits = permit;
+
+  cold->tail = permit;
+}
+
+static loom_permit_t *loom_acquire_a_permit(loom_task_t *task) {
+  loom_task_cold_t *cold = loom_task_pool_cold(S->tasks, task);
+
+  if (task->permits == NULL)
+    cold->blocks = 0;
+
+  const loom_uint32_t blocker = cold->blocks++;
+
+  loom_permit_t *permit = (blocker < LOOM_EMBEDDED_PERMITS)
+                        ? &cold->permits[blocker]
+                        : loom_permit_pool_acquire(S->permits, C);
+
+  loom_link_a_permit(task, cold, permit);
+
+  return permit;
+}
+
+// Acquires up to @n permits for @task, linking each after the last. Returns
+// the number acquired, which is always non-zero.
+static loom_uint32_t loom_acquire_n_permits(loom_task_t *task,
+                                            loom_uint32_t n,
+                                            loom_permit_t **permits) {
+  loom_task_cold_t *cold = loom_task_pool_cold(S->tasks, task);
+
+  if ((task->permits == NULL) || (cold->blocks < LOOM_EMBEDDED_PERMITS)) {
+    permits[0] = loom_acquire_a_permit(task);
+    return 1;
+  }
+
+  const loom_uint32_t acquired = loom_permit_pool_acquire_n(S->permits, n, permits);
+
+  cold->blocks += acquired;
+
+  for (loom_uint32_t permit = 0; permit < acquired; ++permit)
+    loom_link_a_permit(task, cold, permits[permit]);
+
+  return acquired;
+}
+
+static void loom_return_a_permit(loom_task_cold_t *cold, loom_permit_t *permit) {
+  const loom_permit_t *lower = &cold->permits[0];
+  const loom_permit_t *upper = &cold->permits[LOOM_EMBEDDED_PERMITS - 1];
+
+  if ((permit >= lower) && (permit <= upper))
+    // Ingore if embedded.
+    return;
+
+  loom_permit_pool_return(S->permits, C, permit);
+}
+
+// Picks the parked worker closest to us. Workers are pinned to cores in
+// order, so neighbours are more likely to share a cache or a node.
+static unsigned loom_nearest_sleeper(loom_native_t sleepers) {
+  const loom_native_t above = sleepers & ~(((loom_native_t)2 << q) - 1);
+  const loom_native_t below = sleepers & (((loom_native_t)1 << q) - 1);
+
+  if (below == 0)
+    return loom_ctz_native(above);
+
+  const unsigned down = (LOOM_BYTES_TO_BITS(sizeof(loom_native_t)) - 1) - loom_clz_native(below);
+
+  if (above == 0)
+    return down;
+
+  const unsigned up = loom_ctz_native(above);
+
+  return ((up - q) <= (q - down)) ? up : down;
+}
+
+#if LOOM_IO_URING
+
+// States of `io_waiter`.
+enum {
+  LOOM_IO_NO_WAITER = 0,
+  LOOM_IO_WAITING   = 1,
+  LOOM_IO_WOKEN     = 2
+};
+
+// Wakes the worker waiting on the ring, if any, by completing a no-op. Only
+// one no-op is submitted per wait.
+static void loom_wake_io_waiter(void) {
+  if (loom_atomic_cmp_and_xchg_u32(&S->io_waiter, LOOM_IO_WAITING, LOOM_IO_WOKEN) != LOOM_IO_WAITING)
+    return;
+
+  if (!loom_io_ring_submit(S->io, LOOM_IO_RING_NOP, -1, NULL, 0, 0, NULL))
+    // Full, so let whoever comes next try again.
+    loom_atomic_cmp_and_xchg_u32(&S->io_waiter, LOOM_IO_WOKEN, LOOM_IO_WAITING);
+}
+
+#endif
+
+// Wakes a single parked worker to pick up work we've made available, unless
+// another worker is already searching and bound to find it.
+//
+// Making work available is always a full barrier, so searchers either see
+// our work before parking, or we see them parked.
+static void loom_wake_a_worker(void) {
+  if (loom_atomic_load_u32(&S->searching) > 0)
+    return;
+
+  while (1) {
+    const loom_native_t sleepers = loom_atomic_load_native(&S->sleepers);
+
+    if (sleepers == 0) {
+    #if LOOM_IO_URING
+      // Nobody is parked, but a worker waiting on the ring isn't busy either.
+      loom_wake_io_waiter();
+    #endif
+
+      // Everybody is busy.
+      return;
+    }
+
+    const unsigned worker = loom_nearest_sleeper(sleepers);
+
+    // Only wake if we're the one that claimed it.
+    if (loom_atomic_reset_native(&S->sleepers, worker)) {
+      loom_event_signal(S->workers[worker - 1].parking);
+      return;
+    }
+  }
+}
+
+static void loom_signal_availability_of_work(unsigned priority) {
+  loom_atomic_set_native(&S->work[priority].bits, q);
+  loom_wake_a_worker();
+}
+
+// Submits a task from a thread without a work queue of its own.
+static void loom_inject_a_task(loom_task_t *task, unsigned priority) {
+  while (!loom_injection_queue_enqueue(S->injected[priority], task))
+    // Full. Wait for workers to drain it.
+    loom_thread_yield();
+
+  loom_wake_a_worker();
+}
+
+static void loom_advertise_work(unsigned priority, loom_uint32_t work);
+
+// Queues a task that's ready to be scheduled.
+static void loom_push_a_task(loom_task_t *task, unsigned priority) {
+  if (Q == NULL) {
+    // Not the main thread or a worker.
+    loom_inject_a_task(task, priority);
+    return;
+  }
+
+  loom_advertise_work(priority, loom_work_queue_push(Q[priority], task));
+}
+
+// Decides whether to wake a worker after queuing tasks, given the resulting
+// amount of @work queued.
+static void loom_advertise_work(unsigned priority, loom_uint32_t work) {
+  if (work > 1) {
+    // We've got more work queued than we are able to schedule. Signal another
+    // worker to steal some.
+    loom_signal_availability_of_work(priority);
+  } else {
+    if (q == 0) {
+      if (S->always_steal_from_main_thread) {
+        // No guarantee that the main thread will schedule work, so wake a
+        // worker to steal, just in case.
+        loom_signal_availability_of_work(priority);
+      }
+    }
+  }
+}
+
+static void loom_submit_a_task(loom_task_t *task) {
+  if (loom_atomic_cmp_and_xchg_u32(&task->blockers, 0, 0xffffffff) != 0)
+    // Can't schedule yet. Should be picked up later.
+    return;
+
+  loom_push_a_task(task, loom_priority_of(task));
+}
+
+// Try to grab a task of the given priority from this worker's queues.
+static loom_task_t *loom_grab_a_task(unsigned priority) {
+  loom_work_queue_t *wq = Q[priority];
+
+  if (!loom_work_queue_is_empty(wq))
+    if (loom_task_t *task = loom_work_queue_pop(wq))
+      return task;
+
+  // No work left in our queue.
+  if (loom_atomic_load_native(&S->work[priority].bits) & ((loom_native_t)1 << q))
+    loom_atomic_reset_native(&S->work[priority].bits, q);
+
+  return NULL;
+}
+
+// Try to steal a task of the given priority from other worker's queues.
+static loom_task_t *loom_steal_a_task(unsigned priority) {
+  // To reduce contention, we only attempt to steal from a victim a few times,
+  // opting to move on to the next victim if we don't succeed. In the
+  // unforunate case we fail to steal from every victim, we give up rather
+  // than try again, so callers get to look at lower priority classes.
+
+  loom_injection_queue_t *iq = S->injected[priority];
+
+  // Tasks submitted from other threads take precedence, as no one else is
+  // going to pick them up.
+  if (loom_task_t *task = loom_injection_queue_dequeue(iq)) {
+    if (!loom_injection_queue_is_empty(iq))
+      // Get another worker to help drain.
+      loom_wake_a_worker();
+
+    return task;
+  }
+
+  loom_native_t victims = loom_atomic_load_native(&S->work[priority].bits);
+
+  // Make sure we don't try to steal from ourself.
+  victims &= ~((loom_native_t)1 << q);
+
+  if (!victims)
+    // No work to steal.
+    return NULL;
+
+  // Naively enumerating the work work queues introduces a bias toward
+  // earlier work queues and will more than likely cause cascading starvation
+  // of worker threads, degenerating scheduling into a free-for-all. To
+  // combat this, we rotate `victims` by a random amount and enumerate as we
+  // would normally, taking the rotation into count when selecting the work
+  // queue to victimize.
+  static const unsigned w = sizeof(victims) * CHAR_BIT;
+  const loom_native_t r = loom_prng_grab_u32(P) % w;
+  victims = (victims << r) | (victims >> ((-r) % w));
+
+  while (victims) {
+    const unsigned v = (loom_ctz_native(victims) + (w - r)) % w;
+
+    loom_work_queue_t *wq = S->queues[v][priority];
+
+    // Retry try a few times, in case of contention.
+    for (unsigned attempts = 0; attempts < 3; ++attempts) {
+      loom_uint32_t stolen;
+
+      if (loom_task_t *task = loom_work_queue_steal(wq, Q[priority], &stolen)) {
+        if (stolen > 2)
+          // We took more than we can schedule. Let another worker steal
+          // from us in turn.
+          loom_signal_availability_of_work(priority);
+
+        return task;
+      }
+    }
+
+    if (loom_work_queue_is_empty(wq)) {
+      // Stale, so don't lead anybody else here. Its owner only advertises
+      // work as it pushes, so we put the bit back if we raced with a push.
+      loom_atomic_reset_native(&S->work[priority].bits, v);
+
+      if (!loom_work_queue_is_empty(wq))
+        loom_atomic_set_native(&S->work[priority].bits, v);
+    }
+
+    victims &= (victims - 1);
+  }
+
+  return NULL;
+}
+
+#if LOOM_IO_URING
+static loom_bool_t loom_poll_io(void);
+#endif
+
+// Try to find a task, in order of priority. We'll steal higher priority work
+// from other workers before working on lower priority work of our own.
+static loom_task_t *loom_find_a_task(void) {
+#if LOOM_IO_URING
+  // Completing I/O tasks is cheap, and may make work available.
+  loom_poll_io();
+#endif
+
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority) {
+    if (loom_task_t *task = loom_grab_a_task(priority))
+      return task;
+
+    if (loom_task_t *task = loom_steal_a_task(priority))
+      return task;
+  }
+
+  return NULL;
+}
+
+static void loom_unblock_any_permitted(loom_task_t *task) {
+  // Tasks should not be modified by other threads once scheduled, so no race.
+  if (task->permits) {
+    loom_task_cold_t *cold = loom_task_pool_cold(S->tasks, task);
+
+    loom_permit_t *permit = task->permits;
+
+    while (permit) {
+      if (loom_atomic_decr_u32(&permit->task->blockers) == 0) {
+        // Submit to this worker's queue.
+        loom_submit_a_task(permit->task);
+      }
+
+      loom_permit_t *const next = permit->next;
+      loom_return_a_permit(cold, permit);
+      permit = next;
+    }
+  }
+}
+
+// Marks tasks owned by a graph, rather than the task pool.
+#define LOOM_TASK_RECORDED 0x40000000ul
+
+typedef struct loom_graph_node {
+  loom_kernel_fn kernel;
+  void *data;
+  loom_uint32_t flags;
+} loom_graph_node_t;
+
+typedef struct loom_graph_edge {
+  loom_uint32_t from;
+  loom_uint32_t to;
+} loom_graph_edge_t;
+
+struct loom_graph {
+  // Recorded nodes and edges. Discarded once compiled.
+  loom_graph_node_t *nodes;
+  loom_uint32_t number_of_nodes;
+  loom_uint32_t capacity_of_nodes;
+
+  loom_graph_edge_t *edges;
+  loom_uint32_t number_of_edges;
+  loom_uint32_t capacity_of_edges;
+
+  loom_bool_t compiled;
+
+  // A task per node, reused every replay.
+  loom_task_t *tasks;
+  loom_uint32_t n;
+
+  // Number of predecessors of each node, which its blockers are reset to.
+  loom_uint32_t *predecessors;
+
+  // Successors of each node `i` are `successors[offsets[i]]` through
+  // `successors[offsets[i + 1] - 1]`.
+  loom_uint32_t *offsets;
+  loom_uint32_t *successors;
+
+  // Nodes without predecessors, kicked to start a replay.
+  loom_uint32_t *roots;
+  loom_uint32_t number_of_roots;
+
+  // Counts nodes yet to be completed during a replay.
+  loom_counter_t outstanding;
+};
+
+// Recorded tasks keep a pointer back to their graph in their payload, as
+// they're never described with one.
+static loom_graph_t *loom_graph_of(const loom_task_t *task) {
+  return (loom_graph_t *)task->payload.__alignment_of_pointer__;
+}
+
+static void loom_unblock_any_successors(loom_task_t *task) {
+  loom_graph_t *graph = loom_graph_of(task);
+
+  const loom_uint32_t node = task->index;
+
+  for (loom_uint32_t edge = graph->offsets[node]; edge < graph->offsets[node + 1]; ++edge) {
+    loom_task_t *successor = &graph->tasks[graph->successors[edge]];
+
+    if (loom_atomic_decr_u32(&successor->blockers) == 0)
+      loom_submit_a_task(successor);
+  }
+}
+
+// Set on a counter while a thread is blocked waiting for it to reach its
+// target. Left set afterwards, in case of other waiters.
+#define LOOM_COUNTER_WAITER 0x80000000ul
+
+// Set on a counter while a fiber task is suspended waiting for it to drop to
+// zero. Cleared by whoever brings it to zero, before resuming the task.
+#define LOOM_COUNTER_SUSPENDED 0x40000000ul
+
+// Toggled whenever a thread publishes a new target, so that releases that
+// loaded the previous target fail to decrement and retry.
+#define LOOM_COUNTER_EPOCH 0x20000000ul
+
+#define LOOM_COUNTER_FLAGS (LOOM_COUNTER_WAITER | LOOM_COUNTER_SUSPENDED | LOOM_COUNTER_EPOCH)
+
+static void loom_release_counter(loom_counter_t *counter) {
+  // Whoever we release may return, and the counter cease to exist, as soon as
+  // we decrement it. So we load everything we need beforehand.
+  loom_uint32_t observed;
+  loom_uint32_t remaining;
+  loom_uint32_t target;
+
+  loom_task_t *suspended;
+
+  do {
+    observed = loom_atomic_load_u32(&counter->value);
+
+    // Targets and suspended tasks are published prior to the flags or epoch
+    // that announce them.
+    loom_atomic_acquire();
+
+    target = loom_atomic_load_u32(&counter->target);
+
+    remaining = observed - 1;
+
+    suspended = NULL;
+
+  #if LOOM_FIBERS
+    if ((remaining & ~LOOM_COUNTER_FLAGS) == 0 && (remaining & LOOM_COUNTER_SUSPENDED)) {
+      // We'll resume the suspended task, so clear the flag along with the
+      // decrement. The task clears `waiting` itself, once resumed.
+      suspended = (loom_task_t *)loom_atomic_load_ptr(&counter->waiting);
+      remaining &= ~LOOM_COUNTER_SUSPENDED;
+    }
+  #endif
+  } while (loom_atomic_cmp_and_xchg_u32(&counter->value, observed, remaining) != observed);
+
+#if LOOM_FIBERS
+  if (suspended)
+    loom_push_a_task(suspended, loom_priority_of(suspended));
+#endif
+
+  if (!(remaining & LOOM_COUNTER_WAITER))
+    return;
+
+  if ((remaining & ~LOOM_COUNTER_FLAGS) != target)
+    return;
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS || \
+    LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // The waiter may return, and the counter cease to exist, before we wake
+  // it. We only hand the kernel its address, never touching it, so at worst
+  // that results in a spurious wakeup for somebody else.
+  loom_futex_wake_all(&counter->value);
+#endif
+}
+
+#if LOOM_FIBERS
+
+static LOOM_NOINLINE loom_fiber_t *loom_current_fiber(void) {
+  return F;
+}
+
+static LOOM_NOINLINE loom_fiber_context_t loom_return_context(void) {
+  return R;
+}
+
+static void loom_fiber_entry(void *fiber_ptr) {
+  loom_fiber_t *fiber = (loom_fiber_t *)fiber_ptr;
+
+  loom_task_t *task = fiber->task;
+
+  task->work.fiber.kernel(task->work.fiber.data);
+
+  fiber->state = LOOM_FIBER_DONE;
+
+  // We may have been resumed by another thread, so we look up where to
+  // return to through a call rather than risk a stale thread-local.
+  loom_fiber_switch(&fiber->context, loom_return_context());
+
+  LOOM_UNREACHABLE();
+}
+
+// Suspends the calling fiber until @counter drops to zero.
+static LOOM_NOINLINE void loom_suspend_on(loom_counter_t *counter) {
+  loom_fiber_t *fiber = loom_current_fiber();
+
+  fiber->counter = counter;
+  fiber->state = LOOM_FIBER_SUSPENDED;
+
+  loom_fiber_switch(&fiber->context, loom_return_context());
+
+  // Resumed, possibly on another thread, so don't touch thread-locals. The
+  // counter outlives us, so we're free to let another task wait on it.
+  loom_atomic_store_ptr(&counter->waiting, NULL);
+}
+
+// Registers @task as waiting on @counter, after its fiber has suspended.
+// Returns false if the counter has already dropped to zero, in which case
+// the task should be resumed immediately.
+static loom_bool_t loom_park_on_counter(loom_task_t *task,
+                                        loom_counter_t *counter) {
+  // Only one fiber task can wait on a counter at a time. See
+  // `loom_wait_for_counter`.
+  loom_assert_debug(loom_atomic_load_ptr(&counter->waiting) == NULL);
+
+  loom_atomic_store_ptr(&counter->waiting, (void *)task);
+
+  while (1) {
+    const loom_uint32_t observed = loom_atomic_load_u32(&counter->value);
+
+    if ((observed & ~LOOM_COUNTER_FLAGS) == 0) {
+      // Nobody knows we're waiting, so nobody will resume us.
+      loom_atomic_store_ptr(&counter->waiting, NULL);
+      return false;
+    }
+
+    // Whoever brings the counter to zero will see this, and resume us.
+    if (loom_atomic_cmp_and_xchg_u32(&counter->value, observed, observed | LOOM_COUNTER_SUSPENDED) == observed)
+      return true;
+  }
+}
+
+// Runs or resumes a fiber task. Returns false if suspended, in which case
+// it's requeued once whatever it's waiting on is done.
+static loom_bool_t loom_run_a_fiber(loom_task_t *task) {
+  loom_fiber_t *fiber = (loom_fiber_t *)task->fiber;
+
+  if (fiber == NULL) {
+    fiber = loom_fiber_pool_acquire(S->fibers);
+
+    if (fiber == NULL) {
+      // Out of fibers, so run it like any other task.
+      task->work.fiber.kernel(task->work.fiber.data);
+      return true;
+    }
+
+    fiber->task = task;
+    fiber->context = loom_fiber_prepare(fiber->stack,
+                                        S->fibers->size_of_each_stack,
+                                        &loom_fiber_entry,
+                                        (void *)fiber);
+
+    task->fiber = (void *)fiber;
+  }
+
+  // Fiber tasks can be scheduled while waiting within other fiber tasks, in
+  // which case we're running on the outer fiber and must restore it.
+  loom_fiber_t *const outer = F;
+  const loom_fiber_context_t outer_return_context = R;
+
+  do {
+    fiber->state = LOOM_FIBER_RUNNING;
+
+    F = fiber;
+    loom_fiber_switch(&R, fiber->context);
+    F = outer;
+    R = outer_return_context;
+
+    if (fiber->state == LOOM_FIBER_DONE) {
+      task->fiber = NULL;
+      loom_fiber_pool_return(S->fibers, fiber);
+      return true;
+    }
+  } while (!loom_park_on_counter(task, fiber->counter));
+
+  return false;
+}
+
+#endif
+
+#if LOOM_IO_URING
+
+// Number of completions reaped at once.
+#define LOOM_IO_REAP_LIMIT 16
+
+// Default number of operations that can be in flight at once.
+#define LOOM_DEFAULT_IO 256
+
+static void loom_complete_a_task(loom_task_t *task);
+
+// Completes any I/O tasks whose operations have completed. Returns true if
+// any were.
+static loom_bool_t loom_poll_io(void) {
+  if (S->io == NULL)
+    return false;
+
+  loom_io_completion_t completions[LOOM_IO_REAP_LIMIT];
+
+  const unsigned n = loom_io_ring_reap(S->io, completions, LOOM_IO_REAP_LIMIT);
+
+  unsigned completed = 0;
+
+  for (unsigned i = 0; i < n; ++i) {
+    loom_task_t *task = (loom_task_t *)completions[i].user;
+
+    if (task == NULL)
+      // Woke whoever was waiting on the ring.
+      continue;
+
+    if (task->work.io.request->result)
+      *task->work.io.request->result = completions[i].result;
+
+    loom_complete_a_task(task);
+
+    completed += 1;
+  }
+
+  if (completed) {
+    const loom_uint32_t in_flight = loom_atomic_fetch_and_add_u32(&S->io_in_flight, -completed) - completed;
+
+    if (in_flight == 0)
+      // Whoever is waiting may have checked before we reaped what they were
+      // waiting on, and would otherwise wait until more I/O is submitted.
+      loom_wake_io_waiter();
+  }
+
+  return (completed > 0);
+}
+
+// Blocks the calling worker on the ring, if I/O is in flight and no other
+// worker is already. Returns false if it didn't.
+static loom_bool_t loom_wait_on_io(void) {
+  if (S->io == NULL)
+    return false;
+
+  if (loom_atomic_load_u32(&S->io_in_flight) == 0)
+    return false;
+
+  if (loom_atomic_cmp_and_xchg_u32(&S->io_waiter, LOOM_IO_NO_WAITER, LOOM_IO_WAITING) != LOOM_IO_NO_WAITER)
+    return false;
+
+  // Whoever reaps the last completion in flight wakes us, so we can't miss
+  // it dropping to zero after checking. Likewise, whoever makes work available
+  // while nobody is parked.
+  if (loom_atomic_load_u32(&S->io_in_flight))
+    loom_io_ring_wait(S->io);
+
+  loom_atomic_store_u32(&S->io_waiter, LOOM_IO_NO_WAITER);
+
+  return true;
+}
+
+#endif
+
+// Performs the operation described by an I/O task. Returns true if it was
+// submitted, in which case the task is completed once it completes.
+static loom_bool_t loom_start_io(loom_task_t *task) {
+  const loom_io_t *io = task->work.io.request;
+
+#if LOOM_IO_URING
+  if (S->io) {
+    if (loom_atomic_incr_u32(&S->io_in_flight) <= S->io_limit) {
+      if (loom_io_ring_submit(S->io, io->op, io->fd, io->buffer, io->size, io->offset, (void *)task)) {
+        // Make sure somebody is around to wait on the ring.
+        if (loom_atomic_load_u32(&S->io_waiter) == LOOM_IO_NO_WAITER)
+          loom_wake_a_worker();
+        return true;
+      }
+    }
+
+    // Too much in flight, so we perform it ourselves.
+    loom_atomic_decr_u32(&S->io_in_flight);
+  }
+#endif
+
+  const loom_int64_t result = loom_io_perform(io->op, io->fd, io->buffer, io->size, io->offset);
+
+  if (io->result)
+    *io->result = result;
+
+  return false;
+}
+
+// Runs the epilogue, then releases everything waiting on @task.
+static void loom_complete_a_task(loom_task_t *task) {
+  S->epilogue.fn(task, S->epilogue.context);
+
+  if (task->blockers != 0xffffffff) {
+    // Continued by `loom_continue_with`, so only completed once its final
+    // continuation is. We held it back until now, in case what it continues
+    // after has already completed.
+    if (loom_atomic_decr_u32(&task->blockers) == 0)
+      loom_submit_a_task(task);
+
+    return;
+  }
+
+  if (task->flags & LOOM_TASK_RECORDED) {
+    // Graphs can be destroyed as soon as they're completed, and their counter
+    // along with them, so we're done with the graph and the task beforehand.
+    // Releasing never touches a counter once it could let its waiter return.
+    loom_unblock_any_successors(task);
+    loom_release_counter(task->counter);
+    return;
+  }
+
+  if (task->counter)
+    loom_release_counter(task->counter);
+
+  loom_unblock_any_permitted(task);
+
+  // TODO(mtwilliams): Copy to stack and return to pool immediately?
+  loom_return_a_task(task);
+}
+
+static void loom_schedule_a_task(loom_task_t *task) {
+  // Suspended tasks have already been through the prologue.
+  if (task->fiber == NULL)
+    S->prologue.fn(task, S->prologue.context);
+
+  // Tasks can be scheduled while waiting within other tasks.
+  loom_task_t *const outer = T;
+
+  T = task;
+
+  switch (task->work.kind) {
+    case LOOM_WORK_NONE:
+      // Do nothing.
+      break;
+
+    case LOOM_WORK_CPU:
+      task->work.cpu.kernel(task->work.cpu.data);
+      break;
+
+    case LOOM_WORK_FIBER:
+#if LOOM_FIBERS
+      if (!loom_run_a_fiber(task)) {
+        // Picked up again once resumed.
+        T = outer;
+        return;
+      }
+#else
+      task->work.fiber.kernel(task->work.fiber.data);
+#endif
+      break;
+
+    case LOOM_WORK_IO:
+      if (loom_start_io(task)) {
+        // Completed once its operation is. See `loom_poll_io`.
+        T = outer;
+        return;
+      }
+      break;
+  }
+
+  T = outer;
+
+  loom_complete_a_task(task);
+}
+
+// Quick check for any work we could find, to avoid hammering other workers'
+// queues while spinning.
+static loom_bool_t loom_any_work_available(void) {
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority) {
+    if (loom_atomic_load_native(&S->work[priority].bits))
+      return true;
+
+    if (!loom_injection_queue_is_empty(S->injected[priority]))
+      return true;
+  }
+
+#if LOOM_IO_URING
+  if (S->io && loom_io_ring_any_completed(S->io))
+    return true;
+#endif
+
+  return false;
+}
+
+// Updates the spin budget of @worker after being idle for @gap nanoseconds.
+static void loom_adapt_to_gap(loom_worker_t *worker, loom_uint64_t gap) {
+  if (!S->adaptive)
+    return;
+
+  worker->gap = worker->gap ? (worker->gap * 7 + gap) / 8 : gap;
+
+  if (worker->gap < S->spin)
+    // Spin long enough to catch most bursts.
+    worker->budget = (2 * worker->gap < S->spin) ? 2 * worker->gap : S->spin;
+  else
+    // Work takes too long to turn up for spinning to pay off.
+    worker->budget = 0;
+}
+
+enum {
+  LOOM_IDLE_SHUTDOWN = 0,
+  LOOM_IDLE_WORK = 1,
+  LOOM_IDLE_PARK = 2
+};
+
+// Number of pause instructions between checks for work while spinning.
+#define LOOM_PAUSES_PER_SPIN 64
+
+// Spins, then yields, until work is available or we've exhausted our limits
+// according to the idle policy.
+static unsigned loom_idle(loom_worker_t *worker, loom_uint64_t idle_since) {
+  loom_uint64_t now = idle_since;
+
+  // Spin.
+  const loom_uint64_t stop_spinning_at = now + worker->budget;
+
+  while (now < stop_spinning_at) {
+    for (unsigned pause = 0; pause < LOOM_PAUSES_PER_SPIN; ++pause)
+      loom_atomic_pause();
+
+    now = loom_clock_now();
+
+    if (loom_atomic_load_u32(&worker->shutdown)) {
+      worker->statistics.spinning += now - idle_since;
+      return LOOM_IDLE_SHUTDOWN;
+    }
+
+    if (loom_any_work_available()) {
+      worker->statistics.spinning += now - idle_since;
+      loom_adapt_to_gap(worker, now - idle_since);
+      return LOOM_IDLE_WORK;
+    }
+  }
+
+  worker->statistics.spinning += now - idle_since;
+
+  // Yield.
+  const loom_uint64_t yielding_since = now;
+  const loom_uint64_t stop_yielding_at = now + S->yield;
+
+  while (now < stop_yielding_at) {
+    loom_thread_yield();
+
+    now = loom_clock_now();
+
+    if (loom_atomic_load_u32(&worker->shutdown)) {
+      worker->statistics.yielding += now - yielding_since;
+      return LOOM_IDLE_SHUTDOWN;
+    }
+
+    if (loom_any_work_available()) {
+      worker->statistics.yielding += now - yielding_since;
+      loom_adapt_to_gap(worker, now - idle_since);
+      return LOOM_IDLE_WORK;
+    }
+  }
+
+  worker->statistics.yielding += now - yielding_since;
+
+  return LOOM_IDLE_PARK;
+}
+
+static void loom_worker_thread(void *worker_ptr) {
+  loom_worker_t *worker = (loom_worker_t *)worker_ptr;
+
+  Q = S->queues[worker->id];
+  q = worker->id;
+  C = &S->caches[worker->id];
+
+  if (P == NULL)
+    P = loom_prng_create();
+
+  // Spin budget starts at the limit, and adapts from there.
+  worker->budget = S->spin;
+
+startup:
+  loom_atomic_set_native(&S->online, q);
+
+  while (1) {
+  idle:
+    loom_uint64_t idle_since = loom_clock_now();
+
+    // Spin, then yield, in case more work turns up shortly.
+    loom_atomic_incr_u32(&S->searching);
+    const unsigned outcome = loom_idle(worker, idle_since);
+    loom_atomic_decr_u32(&S->searching);
+
+    switch (outcome) {
+      case LOOM_IDLE_SHUTDOWN:
+        goto shutdown;
+
+      case LOOM_IDLE_WORK:
+        goto working;
+
+      case LOOM_IDLE_PARK:
+        break;
+    }
+
+#if LOOM_IO_URING
+    // Rather than park, one worker waits on any I/O in flight so that its
+    // completion is picked up promptly.
+    if (loom_wait_on_io())
+      goto working;
+#endif
+
+    // Advertise that we're parked, then check once more, as work may have
+    // been made available after we stopped searching but before anybody could
+    // see us parked.
+    loom_atomic_set_native(&S->sleepers, q);
+
+    if (loom_atomic_load_u32(&worker->shutdown) || loom_any_work_available()) {
+      // We may have been woken in the meantime, in which case we'll wake up
+      // spuriously next time we park. That's harmless.
+      loom_atomic_reset_native(&S->sleepers, q);
+      goto working;
+    }
+
+    {
+      const loom_uint64_t parked_since = loom_clock_now();
+
+      loom_event_wait(worker->parking, -1);
+
+      worker->statistics.parked += loom_clock_now() - parked_since;
+    }
+
+    // Whoever woke us has already cleared our bit, unless we're shutting down.
+    loom_atomic_reset_native(&S->sleepers, q);
+
+    if (loom_atomic_load_u32(&worker->shutdown))
+      goto shutdown;
+
+    loom_adapt_to_gap(worker, loom_clock_now() - idle_since);
+
+  working:
+    // Work through our queues, and steal work, until none is left at all.
+    while (1) {
+      if (loom_atomic_load_u32(&worker->shutdown))
+        goto shutdown;
+
+      if (loom_task_t *task = loom_find_a_task())
+        loom_schedule_a_task(task);
+      else
+        goto idle;
+    }
+  }
+
+shutdown:
+  loom_atomic_reset_native(&S->online, q);
+
+  // Let another thread drain our queues, or take over stealing work.
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+    if (!loom_work_queue_is_empty(Q[priority]))
+      loom_signal_availability_of_work(priority);
+}
+
+// Returns the number of logical cores available.
+static loom_uint32_t number_of_cores(void) {
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  SYSTEM_INFO system_info;
+  GetNativeSystemInfo(&system_info);
+  return system_info.dwNumberOfProcessors;
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#endif
+}
+
+static loom_uint32_t choose_number_of_workers(loom_int32_t workers) {
+  if (workers < 0)
+    workers = number_of_cores() + workers;
+
+  if (workers >= LOOM_WORKER_LIMIT)
+    workers = LOOM_WORKER_LIMIT - 1;
+
+  return workers;
+}
+
+static loom_uint32_t memory_flags_for_pages(loom_uint32_t pages) {
+  switch (pages) {
+    case LOOM_PAGES_TRANSPARENT_HUGE:
+      return LOOM_MEMORY_TRANSPARENT_HUGE_PAGES;
+
+    case LOOM_PAGES_HUGE:
+      return LOOM_MEMORY_HUGE_PAGES;
+  }
+
+  return 0;
+}
+
+void loom_initialize(const loom_options_t *options) {
+  loom_assert_debug(options != NULL);
+
+  // Prevent double initialization.
+  loom_assert_debug(S == NULL);
+
+  S = loom_task_scheduler_create(options->tasks,
+                                 options->permits,
+                                 options->queue,
+                                 options->injection,
+                                 memory_flags_for_pages(options->pages));
+
+  if (options->prologue.fn)
+    S->prologue = options->prologue;
+
+  if (options->epilogue.fn)
+    S->epilogue = options->epilogue;
+
+  S->always_steal_from_main_thread = !options->main_thread_does_work;
+
+  S->numa = options->numa;
+
+  S->spin = (loom_uint64_t)options->idle.spin * 1000;
+  S->yield = (loom_uint64_t)options->idle.yield * 1000;
+  S->adaptive = options->idle.adaptive;
+
+#if LOOM_FIBERS
+  S->fibers = loom_fiber_pool_create(options->fibers ? options->fibers : LOOM_DEFAULT_FIBERS,
+                                     options->fiber_stack ? options->fiber_stack : LOOM_DEFAULT_FIBER_STACK);
+#endif
+
+#if LOOM_IO_URING
+  S->io_limit = options->io ? options->io : LOOM_DEFAULT_IO;
+  S->io = loom_io_ring_create(S->io_limit);
+#endif
+
+  const loom_uint32_t workers =
+    choose_number_of_workers(options->workers);
+
+  loom_bring_up_workers(workers);
+
+  Q = S->queues[0];
+  q = 0;
+  C = &S->caches[0];
+
+  if (P == NULL)
+    P = loom_prng_create();
+}
+
+void loom_shutdown(void) {
+  loom_assert_debug(S != NULL);
+
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+    while (loom_atomic_load_native(&S->work[priority].bits) || !loom_injection_queue_is_empty(S->injected[priority]))
+      if (!loom_do_some_work())
+        loom_thread_yield();
+
+#if LOOM_IO_URING
+  // Buffers may be in use by the kernel until then.
+  while (loom_atomic_load_u32(&S->io_in_flight))
+    if (!loom_do_some_work())
+      loom_thread_yield();
+#endif
+
+  loom_bring_down_workers(S->n);
+
+  loom_task_scheduler_destroy(S);
+
+  S = NULL;
+  Q = NULL;
+  q = 0;
+  C = NULL;
+}
+
+void loom_bring_up_workers(unsigned n) {
+  loom_lock_acquire(S->lock);
+
+  // REFACTOR(mtwilliams): Silently limit?
+  loom_assert_debug(S->n + n <= LOOM_WORKER_LIMIT);
+
+  for (unsigned worker = S->n; n > 0; --n, ++worker) {
+    // Make sure not already online.
+    loom_assert_debug(S->workers[worker].thread == NULL);
+
+    loom_thread_options_t worker_thread_options;
+
+    char worker_thread_name[17];
+    snprintf(&worker_thread_name[0], 16, "Worker %02u", worker + 1);
+    worker_thread_name[16] = '\0';
+
+    worker_thread_options.name = &worker_thread_name[0];
+
+  #if LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86
+    worker_thread_options.affinity = (1ul << worker);
+  #elif LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64
+    worker_thread_options.affinity = (1ull << worker);
+  #endif
+
+    worker_thread_options.stack = 0;
+
+    // Workers are pinned to a core, so we know where their queues belong.
+    const loom_int32_t node =
+      S->numa ? loom_memory_node_of_core(worker) : LOOM_MEMORY_ANY_NODE;
+
+    for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+      if (S->queues[worker + 1][priority] == NULL)
+        S->queues[worker + 1][priority] = loom_work_queue_create(S->size_of_each_work_queue, S->memory, node);
+
+    S->workers[worker].thread = loom_thread_spawn(&loom_worker_thread,
+                                                  (void *)&S->workers[worker],
+                                                  &worker_thread_options);
+
+    S->n += 1;
+  }
+
+  loom_lock_release(S->lock);
+}
+
+void loom_bring_down_workers(unsigned n) {
+  loom_lock_acquire(S->lock);
+
+  // REFACTOR(mtwilliams): Silently limit?
+  loom_assert_debug(S->n >= n);
+
+  // Post shutdown messages.
+  for (unsigned worker = S->n; worker > S->n - n; --worker) {
+    // Make sure not already offline.
+    loom_assert_debug(S->workers[worker - 1].thread != NULL);
+
+    // Flag for shutdown.
+    loom_atomic_store_u32(&S->workers[worker - 1].shutdown, 1);
+  }
+
+  // Wake up, so they acknowledge.
+  for (unsigned worker = S->n; worker > S->n - n; --worker)
+    loom_event_signal(S->workers[worker - 1].parking);
+
+#if LOOM_IO_URING
+  // One may be waiting on the ring rather than parked.
+  loom_wake_io_waiter();
+#endif
+
+  for (unsigned worker = S->n; n > 0; --n, --worker) {
+    loom_thread_join(S->workers[worker - 1].thread);
+
+    // No longer any associated worker thread.
+    S->workers[worker - 1].thread = NULL;
+
+    // Prevent shutdown if brought up again.
+    loom_atomic_store_u32(&S->workers[worker - 1].shutdown, 0);
+
+    S->n -= 1;
+  }
+
+  loom_lock_release(S->lock);
+}
+
+/// \brief A block of memory scratch allocations are carved from.
+///
+/// \details Blocks are chained so they can be reused after an arena is reset,
+/// rather than returned to the system.
+///
+typedef struct loom_arena_block {
+  struct loom_arena_block *next;
+  loom_size_t size;
+} loom_arena_block_t;
+
+// Memory handed out by a block follows its header.
+#define LOOM_ARENA_BLOCK_HEADER LOOM_CACHE_LINE
+
+/// \brief The portion of an arena a single thread allocates from.
+typedef struct LOOM_ALIGNED(LOOM_CACHE_LINE) loom_arena_slab {
+  // All blocks acquired by this slab, in order.
+  loom_arena_block_t *blocks;
+
+  // Block currently being allocated from.
+  loom_arena_block_t *block;
+
+  loom_uint8_t *cursor;
+  loom_uint8_t *end;
+} loom_arena_slab_t;
+
+struct loom_arena {
+  loom_size_t size_of_each_block;
+
+  // How to map blocks. See `loom_memory_map`.
+  loom_uint32_t flags;
+
+  // Held while allocating from the slab shared by threads other than the
+  // main thread or a worker.
+  loom_lock_t *lock;
+
+  // A slab per worker and the main thread, and one shared by everybody else.
+  loom_arena_slab_t slabs[LOOM_WORKER_LIMIT + 2];
+};
+
+// Default size of each block, when unspecified.
+#define LOOM_ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+loom_arena_t *loom_arena_create(loom_size_t size_of_each_block) {
+  loom_arena_t *arena =
+    (loom_arena_t *)loom_memory_alloc(sizeof(loom_arena_t), LOOM_CACHE_LINE);
+
+  arena->size_of_each_block = size_of_each_block ? size_of_each_block
+                                                 : LOOM_ARENA_DEFAULT_BLOCK_SIZE;
+
+  arena->flags = S ? S->memory : 0;
+
+  arena->lock = loom_lock_create();
+
+  return arena;
+}
+
+void loom_arena_destroy(loom_arena_t *arena) {
+  for (unsigned slab = 0; slab < (LOOM_WORKER_LIMIT + 2); ++slab) {
+    loom_arena_block_t *block = arena->slabs[slab].blocks;
+
+    while (block) {
+      loom_arena_block_t *next = block->next;
+      loom_memory_unmap((void *)block, block->size, arena->flags);
+      block = next;
+    }
+  }
+
+  loom_lock_destroy(arena->lock);
+
+  loom_memory_free((void *)arena);
+}
+
+static void loom_arena_slab_use(loom_arena_slab_t *slab,
+                                loom_arena_block_t *block) {
+  slab->block = block;
+  slab->cursor = (loom_uint8_t *)block + LOOM_ARENA_BLOCK_HEADER;
+  slab->end = (loom_uint8_t *)block + block->size;
+}
+
+// Moves on to the next block in @slab that can fit @size bytes aligned to
+// @alignment, acquiring one if none are left.
+static void loom_arena_slab_refill(loom_arena_t *arena,
+                                   loom_arena_slab_t *slab,
+                                   loom_size_t size,
+                                   loom_size_t alignment) {
+  const loom_size_t required = LOOM_ARENA_BLOCK_HEADER + size + alignment;
+
+  loom_arena_block_t **link = slab->block ? &slab->block->next : &slab->blocks;
+
+  // Skip any reused blocks that are too small. They're picked up again after
+  // the next reset.
+  while (*link && ((*link)->size < required))
+    link = &(*link)->next;
+
+  if (*link == NULL) {
+    const loom_size_t size_of_block =
+      (required > arena->size_of_each_block) ? required : arena->size_of_each_block;
+
+    loom_arena_block_t *block =
+      (loom_arena_block_t *)loom_memory_map(size_of_block, arena->flags, LOOM_MEMORY_ANY_NODE);
+
+    block->next = NULL;
+    block->size = size_of_block;
+
+    *link = block;
+  }
+
+  loom_arena_slab_use(slab, *link);
+}
+
+static void *loom_arena_slab_alloc(loom_arena_t *arena,
+                                   loom_arena_slab_t *slab,
+                                   loom_size_t size,
+                                   loom_size_t alignment) {
+  while (1) {
+    const loom_native_t aligned =
+      ((loom_native_t)slab->cursor + alignment - 1) & ~((loom_native_t)alignment - 1);
+
+    if (slab->block && ((aligned + size) <= (loom_native_t)slab->end)) {
+      slab->cursor = (loom_uint8_t *)(aligned + size);
+      return (void *)aligned;
+    }
+
+    loom_arena_slab_refill(arena, slab, size, alignment);
+  }
+}
+
+void *loom_arena_alloc(loom_arena_t *arena,
+                       loom_size_t size,
+                       loom_size_t alignment) {
+  // Must be a power of two.
+  loom_assert_debug((alignment & (alignment - 1)) == 0);
+
+  if (alignment == 0)
+    alignment = sizeof(void *);
+
+  if (Q != NULL)
+    // We're the only thread that touches our slab.
+    return loom_arena_slab_alloc(arena, &arena->slabs[q], size, alignment);
+
+  loom_lock_acquire(arena->lock);
+
+  void *memory =
+    loom_arena_slab_alloc(arena, &arena->slabs[LOOM_WORKER_LIMIT + 1], size, alignment);
+
+  loom_lock_release(arena->lock);
+
+  return memory;
+}
+
+void loom_arena_reset(loom_arena_t *arena) {
+  for (unsigned slab = 0; slab < (LOOM_WORKER_LIMIT + 2); ++slab) {
+    if (arena->slabs[slab].blocks)
+      loom_arena_slab_use(&arena->slabs[slab], arena->slabs[slab].blocks);
+  }
+}
+
+static loom_handle_t task_to_handle(loom_task_t *task) {
+  loom_handle_t handle;
+
+#if LOOM_CONFIGURATION == LOOM_CONFIGURATION_DEBUG
+  handle.index = task->index;
+  handle.id = task->id;
+#else
+  handle.opaque = (void *)task;
+#endif
+
+  return handle;
 }
 
-static loom_task_scheduler_t *S = NULL;
+static loom_task_t *handle_to_task(loom_handle_t handle) {
+#if LOOM_CONFIGURATION == LOOM_CONFIGURATION_DEBUG
+  loom_task_t *task = loom_task_pool_lookup(S->tasks, handle.index);
+  loom_assert_debug(task->id == handle.id);
+  return task;
+#else
+  return (loom_task_t *)handle.opaque;
+#endif
+}
 
-// We use a thread-local pointer to track the appropriate queue. This makes
-// handling submissions much easier.
-static LOOM_THREAD_LOCAL loom_work_queue_t *Q = NULL;
+loom_handle_t loom_empty(loom_uint32_t flags) {
+  loom_task_t *task = loom_acquire_a_task();
 
-// We also track the index of the queue to simplify house keeping.
-static LOOM_THREAD_LOCAL loom_uint32_t q = 0;
+  task->flags = flags;
 
-// We maintain a pseduo-random number generator per-thread to reduce false
-// sharing, and implications of multi-threaded access.
-static LOOM_THREAD_LOCAL loom_prng_t *P = NULL;
+  task->work.kind = LOOM_WORK_NONE;
 
-static loom_task_t *loom_acquire_a_task(void) {
-  loom_task_t *task = loom_task_pool_acquire(S->tasks);
-  return task;
+  task->permits = NULL;
+
+  task->blockers = 0;
+
+  task->counter = NULL;
+
+  task->fiber = NULL;
+
+  return task_to_handle(task);
 }
 
-static void loom_return_a_task(loom_task_t *task) {
-  loom_task_pool_return(S->tasks, task);
+loom_handle_t loom_describe(loom_kernel_fn kernel,
+                            void *data,
+                            loom_uint32_t flags) {
+  loom_task_t *task = loom_acquire_a_task();
+
+  task->flags = flags;
+
+  task->work.kind = LOOM_WORK_CPU;
+  task->work.cpu.kernel = kernel;
+  task->work.cpu.data = data;
+
+  task->permits = NULL;
+
+  task->blockers = 0;
+
+  task->counter = NULL;
+
+  task->fiber = NULL;
+
+  return task_to_handle(task);
 }
 
-static loom_permit_t *loom_acquire_a_permit(loom_task_t *task) {
-  const loom_uint32_t blocker = loom_atomic_incr_u32(&task->blocks) - 1;
+loom_handle_t loom_describe_with_payload(loom_kernel_fn kernel,
+                                         const void *payload,
+                                         loom_size_t size,
+                                         loom_uint32_t flags) {
+  loom_assert_debug(size <= LOOM_INLINE_PAYLOAD);
+
+  loom_task_t *task = loom_acquire_a_task();
+
+  task->flags = flags;
+
+  memcpy((void *)&task->payload.bytes[0], payload, size);
+
+  task->work.kind = LOOM_WORK_CPU;
+  task->work.cpu.kernel = kernel;
+  task->work.cpu.data = (void *)&task->payload.bytes[0];
+
+  task->permits = NULL;
+
+  task->blockers = 0;
+
+  task->counter = NULL;
+
+  task->fiber = NULL;
+
+  return task_to_handle(task);
+}
+
+void loom_describe_n(unsigned n,
+                     loom_kernel_fn kernel,
+                     void *const *data,
+                     loom_uint32_t flags,
+                     loom_handle_t *handles) {
+  loom_uint32_t indices[2 * LOOM_MAGAZINE_BATCH];
+
+  for (unsigned i = 0; i < n; ) {
+    const loom_uint32_t batch =
+      ((n - i) < (2 * LOOM_MAGAZINE_BATCH)) ? (n - i) : (2 * LOOM_MAGAZINE_BATCH);
+
+    loom_uint32_t id;
+
+    loom_task_pool_acquire_n(S->tasks, C, batch, &indices[0], &id);
+
+    for (loom_uint32_t j = 0; j < batch; ++j, ++i) {
+      loom_task_t *task = loom_task_pool_lookup(S->tasks, indices[j]);
+
+      task->index = indices[j];
+      task->id = id + j;
+
+      task->flags = flags;
+
+      task->work.kind = LOOM_WORK_CPU;
+      task->work.cpu.kernel = kernel;
+      task->work.cpu.data = data ? data[i] : NULL;
+
+      task->permits = NULL;
+
+      task->blockers = 0;
+
+      task->counter = NULL;
+
+      task->fiber = NULL;
+
+      handles[i] = task_to_handle(task);
+    }
+  }
+}
+
+loom_handle_t loom_describe_fiber(loom_kernel_fn kernel,
+                                  void *data,
+                                  loom_uint32_t flags) {
+  loom_task_t *task = loom_acquire_a_task();
+
+  task->flags = flags;
+
+  task->work.kind = LOOM_WORK_FIBER;
+  task->work.fiber.kernel = kernel;
+  task->work.fiber.data = data;
+
+  task->permits = NULL;
+
+  task->blockers = 0;
+
+  task->counter = NULL;
+
+  task->fiber = NULL;
+
+  return task_to_handle(task);
+}
+
+static_assert(sizeof(loom_io_t) <= LOOM_INLINE_PAYLOAD,
+              "I/O requests are copied into tasks.");
+
+static_assert((loom_uint32_t)LOOM_IO_READ == (loom_uint32_t)LOOM_IO_RING_READ &&
+              (loom_uint32_t)LOOM_IO_WRITE == (loom_uint32_t)LOOM_IO_RING_WRITE &&
+              (loom_uint32_t)LOOM_IO_FSYNC == (loom_uint32_t)LOOM_IO_RING_FSYNC,
+              "Operations are passed through as is.");
+
+loom_handle_t loom_describe_io(const loom_io_t *io,
+                               loom_uint32_t flags) {
+  loom_task_t *task = loom_acquire_a_task();
+
+  task->flags = flags;
+
+  memcpy((void *)&task->payload.bytes[0], (const void *)io, sizeof(loom_io_t));
+
+  task->work.kind = LOOM_WORK_IO;
+  task->work.io.request = (loom_io_t *)&task->payload.bytes[0];
+
+  task->permits = NULL;
+
+  task->blockers = 0;
+
+  task->counter = NULL;
+
+  task->fiber = NULL;
+
+  return task_to_handle(task);
+}
+
+static void permit(loom_task_t *task,
+                   loom_task_t *permitee) {
+  loom_permit_t *permit = loom_acquire_a_permit(task);
+
+  permit->task = permitee;
+
+  loom_atomic_incr_u32(&permitee->blockers);
+}
+
+void loom_permits(loom_handle_t task,
+                  loom_handle_t permitee) {
+  permit(handle_to_task(task), handle_to_task(permitee));
+}
+
+void loom_permits_n(loom_handle_t task,
+                    unsigned n,
+                    const loom_handle_t *permitees) {
+  loom_task_t *permitter = handle_to_task(task);
+
+  loom_permit_t *permits[LOOM_MAGAZINE_BATCH];
+
+  for (unsigned i = 0; i < n; ) {
+    const loom_uint32_t acquired =
+      loom_acquire_n_permits(permitter, n - i, &permits[0]);
 
-  if (blocker < LOOM_EMBEDDED_PERMITS) {
-    if (blocker > 0)
-      task->permits[blocker - 1].next = &task->permits[blocker];
+    for (loom_uint32_t j = 0; j < acquired; ++j, ++i) {
+      loom_task_t *permitee = handle_to_task(permitees[i]);
 
-    return &task->permits[blocker];
+      permits[j]->task = permitee;
+
+      loom_atomic_incr_u32(&permitee->blockers);
+    }
+  }
+}
+
+void loom_continue_with(loom_kernel_fn kernel,
+                        void *data,
+                        loom_handle_t after) {
+  loom_task_t *task = T;
+
+  // Must be called from within a kernel, at most once per run.
+  loom_assert_debug(task != NULL);
+  loom_assert_debug(task->blockers == 0xffffffff);
+
+  // Hold the task back until it's done running, which may be after @after is
+  // completed. Released by `loom_schedule_a_task`.
+  task->blockers = 1;
+
+  // Fiber and CPU tasks share a layout, but we don't rely on it.
+  if (task->work.kind == LOOM_WORK_FIBER) {
+    task->work.fiber.kernel = kernel;
+    task->work.fiber.data = data;
   } else {
-    loom_permit_t **next = &task->permits[LOOM_EMBEDDED_PERMITS - 1].next;
+    task->work.cpu.kernel = kernel;
+    task->work.cpu.data = data;
+  }
+
+  permit(handle_to_task(after), task);
+}
+
+void loom_kick(loom_handle_t task) {
+  loom_kick_n(1, &task);
+}
+
+// Submits @n tasks at once. Ready tasks are staged in our queues, then each
+// queue is published with a single barrier, and we decide whether to wake a
+// worker once per queue rather than once per task.
+static void loom_submit_n_tasks(unsigned n, const loom_handle_t *tasks) {
+  if (Q == NULL) {
+    // Not the main thread or a worker.
+    for (unsigned i = 0; i < n; ++i)
+      loom_submit_a_task(handle_to_task(tasks[i]));
+    return;
+  }
+
+  loom_uint32_t staged[LOOM_PRIORITIES] = { 0, };
+  loom_uint32_t room[LOOM_PRIORITIES] = { 0, };
+
+  for (unsigned i = 0; i < n; ++i) {
+    loom_task_t *task = handle_to_task(tasks[i]);
+
+    if (loom_atomic_cmp_and_xchg_u32(&task->blockers, 0, 0xffffffff) != 0)
+      // Can't schedule yet. Should be picked up later.
+      continue;
 
-    while (*next)
-      next = &(*next)->next;
+    const unsigned priority = loom_priority_of(task);
 
-    *next = loom_permit_pool_acquire(S->permits);
+    if (room[priority] == 0)
+      room[priority] = loom_work_queue_make_room(Q[priority], staged[priority]);
 
-    return *next;
+    loom_work_queue_stage(Q[priority], staged[priority], task);
+
+    staged[priority] += 1;
+    room[priority] -= 1;
   }
+
+  for (unsigned priority = 0; priority < LOOM_PRIORITIES; ++priority)
+    if (staged[priority])
+      loom_advertise_work(priority, loom_work_queue_publish(Q[priority], staged[priority]));
 }
 
-static void loom_return_a_permit(loom_permit_t *permit) {
-  void *address = (void *)permit;
+void loom_kick_n(unsigned n, const loom_handle_t *tasks) {
+  loom_submit_n_tasks(n, tasks);
+}
 
-  const void *lower = (const void *)&S->permits->permits[0];
-  const void *upper = (const void *)&S->permits->permits[S->permits->size - 1];
+void loom_kick_and_wait(loom_handle_t task) {
+  loom_kick_and_wait_n(1, &task);
+}
 
-  if ((address < lower) || (address > upper))
-    // Ingore if embedded.
+static loom_bool_t has_reached(const loom_counter_t *counter,
+                               loom_uint32_t value) {
+  return (loom_atomic_load_u32(&counter->value) & ~LOOM_COUNTER_FLAGS) <= value;
+}
+
+// Number of times to check a counter before blocking on it.
+#define LOOM_COUNTER_SPINS 4096
+
+// Waits until @counter reaches @value, or @timeout milliseconds pass. Returns
+// false if timed out.
+static loom_bool_t wait_on_counter(loom_counter_t *counter,
+                                   loom_uint32_t value,
+                                   unsigned timeout) {
+  // Spin for a bit, as tasks tend to be short.
+  for (unsigned spin = 0; spin < LOOM_COUNTER_SPINS; ++spin) {
+    if (has_reached(counter, value))
+      return true;
+
+    loom_atomic_pause();
+  }
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS || \
+    LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  const loom_uint64_t deadline = loom_futex_deadline(timeout);
+
+  loom_atomic_store_u32(&counter->target, value);
+
+  loom_bool_t published = false;
+
+  while (1) {
+    loom_uint32_t observed = loom_atomic_load_u32(&counter->value);
+
+    if ((observed & ~LOOM_COUNTER_FLAGS) <= value)
+      return true;
+
+    if (!published) {
+      // Let the task that brings the counter to our target know to wake us.
+      // Flipping the epoch forces any release that loaded a previous target
+      // to retry, even if we're not the first waiter.
+      const loom_uint32_t announced = (observed | LOOM_COUNTER_WAITER) ^ LOOM_COUNTER_EPOCH;
+
+      if (loom_atomic_cmp_and_xchg_u32(&counter->value, observed, announced) != observed)
+        // Retry.
+        continue;
+
+      published = true;
+      observed = announced;
+    }
+
+    if (!loom_futex_wait(&counter->value, observed, deadline))
+      return has_reached(counter, value);
+  }
+#else
+  // Nothing to block on, so we yield until reached.
+  const loom_uint64_t started = loom_clock_now();
+
+  while (!has_reached(counter, value)) {
+    if ((timeout != (unsigned)-1) && ((loom_clock_now() - started) >= (loom_uint64_t)timeout * 1000000))
+      return false;
+
+    loom_thread_yield();
+  }
+
+  return true;
+#endif
+}
+
+// Suspends the calling fiber task until @counter drops to zero. Returns false
+// without waiting if not called from a fiber task.
+static loom_bool_t suspend_until_zero(loom_counter_t *counter) {
+#if LOOM_FIBERS
+  if (loom_current_fiber() == NULL)
+    return false;
+
+  while (!has_reached(counter, 0))
+    loom_suspend_on(counter);
+
+  return true;
+#else
+  (void)counter;
+  return false;
+#endif
+}
+
+static void kick(unsigned n, const loom_handle_t *tasks, loom_counter_t *counter) {
+  if (counter)
+    loom_atomic_fetch_and_add_u32(&counter->value, n);
+
+  // Tasks may permit each other, so all must be counted before any are
+  // submitted.
+  for (unsigned i = 0; i < n; ++i) {
+    loom_task_t *task = handle_to_task(tasks[i]);
+    task->counter = counter;
+  }
+
+  loom_submit_n_tasks(n, tasks);
+}
+
+void loom_kick_and_wait_n(unsigned n, const loom_handle_t *tasks) {
+  loom_counter_t outstanding = LOOM_COUNTER_INITIALIZER;
+
+  kick(n, tasks, &outstanding);
+
+  if (suspend_until_zero(&outstanding))
     return;
 
-  loom_permit_pool_return(S->permits, permit);
+  wait_on_counter(&outstanding, 0, -1);
 }
 
-static void loom_signal_availability_of_work(void) {
-  loom_atomic_set_native(&S->work, q);
-  loom_event_signal(S->work_to_steal);
+void loom_kick_and_do_work_while_waiting(loom_handle_t task) {
+  loom_kick_and_do_work_while_waiting_n(1, &task);
 }
 
-static void loom_submit_a_task(loom_task_t *task) {
-  if (loom_atomic_cmp_and_xchg_u32(&task->blockers, 0, 0xffffffff) != 0)
-    // Can't schedule yet. Should be picked up later.
+void loom_kick_and_do_work_while_waiting_n(unsigned n,
+                                           const loom_handle_t *tasks) {
+  loom_counter_t outstanding = LOOM_COUNTER_INITIALIZER;
+
+  kick(n, tasks, &outstanding);
+
+  if (suspend_until_zero(&outstanding))
     return;
 
-  const loom_uint32_t work = loom_work_queue_push(Q, task);
+  // We only block briefly, so we can help out if work turns up.
+  while (!has_reached(&outstanding, 0))
+    if (!loom_do_some_work())
+      wait_on_counter(&outstanding, 0, 1);
+}
 
-  if (work > 1) {
-    // We've got more work queued than we are able to schedule. Signal another
-    // worker to steal some.
-    loom_signal_availability_of_work();
-  } else {
-    if (q == 0) {
-      if (S->always_steal_from_main_thread) {
-        // No guarantee that the main thread will schedule work, so wake a
-        // worker to steal, just in case.
-        loom_signal_availability_of_work();
-      }
+void loom_kick_with_counter(loom_handle_t task,
+                            loom_counter_t *counter) {
+  loom_kick_with_counter_n(1, &task, counter);
+}
+
+void loom_kick_with_counter_n(unsigned n,
+                              const loom_handle_t *tasks,
+                              loom_counter_t *counter) {
+  loom_assert_debug(counter != NULL);
+  kick(n, tasks, counter);
+}
+
+loom_uint32_t loom_counter_value(const loom_counter_t *counter) {
+  return loom_atomic_load_u32(&counter->value) & ~LOOM_COUNTER_FLAGS;
+}
+
+void loom_wait_for_counter(loom_counter_t *counter,
+                           loom_uint32_t value) {
+  if ((value == 0) && suspend_until_zero(counter))
+    return;
+
+  while (!has_reached(counter, value)) {
+    if (Q == NULL) {
+      // Nothing we can help out with.
+      wait_on_counter(counter, value, -1);
+      continue;
+    }
+
+    if (loom_task_t *task = loom_find_a_task()) {
+      loom_schedule_a_task(task);
+      continue;
+    }
+
+    // We only block briefly, so we can help out if work turns up.
+    wait_on_counter(counter, value, 1);
+  }
+}
+
+// A range of iterations to perform, and how to perform them.
+typedef struct loom_range {
+  loom_size_t begin;
+  loom_size_t end;
+  loom_size_t grain;
+
+  loom_range_fn kernel;
+  void *data;
+
+  loom_counter_t *counter;
+} loom_range_t;
+
+static_assert(sizeof(loom_range_t) <= LOOM_INLINE_PAYLOAD,
+              "Ranges should be copied into tasks.");
+
+static void loom_parallel_for_kernel(void *range);
+
+// Performs @range in chunks of at most `grain` iterations. Before each chunk,
+// we split off half of what remains if our queue has run dry, as any worker
+// looking to steal from us would come away empty handed. This adapts the
+// number of tasks to the number of thieves that actually turn up, rather
+// than decomposing up front.
+static void loom_parallel_for_range(loom_range_t *range) {
+  loom_work_queue_t *wq = Q[LOOM_PRIORITY_NORMAL];
+
+  while (range->begin < range->end) {
+    const loom_size_t remaining = range->end - range->begin;
+
+    if ((remaining > range->grain) && (loom_work_queue_depth(wq) == 0)) {
+      loom_range_t other = *range;
+
+      other.begin = range->begin + remaining / 2;
+      range->end = other.begin;
+
+      loom_handle_t task =
+        loom_describe_with_payload(&loom_parallel_for_kernel, (const void *)&other, sizeof(other), 0);
+
+      kick(1, &task, range->counter);
+
+      // Lone tasks aren't advertised, but we split precisely so thieves have
+      // something to steal.
+      loom_signal_availability_of_work(LOOM_PRIORITY_NORMAL);
+
+      continue;
     }
+
+    const loom_size_t end =
+      (remaining > range->grain) ? (range->begin + range->grain) : range->end;
+
+    range->kernel(range->begin, end, range->data);
+
+    range->begin = end;
   }
 }
 
-// Try to grab a task from this worker's queue.
-static loom_task_t *loom_grab_a_task(void) {
-  while (!loom_work_queue_is_empty(Q))
-    if (loom_task_t *task = loom_work_queue_pop(Q))
-      return task;
-
-  return NULL;
+static void loom_parallel_for_kernel(void *range) {
+  loom_parallel_for_range((loom_range_t *)range);
 }
 
-// Try to steal a task from other worker's queues.
-static loom_task_t *loom_steal_a_task(void) {
-  // To reduce contention, we only attempt to steal from a victim a few times,
-  // opting to move on to the next victim if we don't succeed. In the
-  // unforunate case we fail to steal from every victim, we try again in a
-  // different order.
+void loom_parallel_for(loom_size_t begin,
+                       loom_size_t end,
+                       loom_size_t grain,
+                       loom_range_fn kernel,
+                       void *data) {
+  loom_assert_debug(begin <= end);
 
-  while (1) {
-    // Race is fine as the newly onlined worker will pick up work.
-    const loom_native_t online = loom_atomic_load_native(&S->online);
-    const loom_native_t offline = ~online;
+  loom_counter_t outstanding = LOOM_COUNTER_INITIALIZER;
 
-    loom_native_t victims = loom_atomic_load_native(&S->work);
+  loom_range_t range;
 
-    // Make sure we don't try to steal from ourself.
-    victims &= ~(1 << q);
+  range.begin = begin;
+  range.end = end;
+  range.grain = grain ? grain : 1;
+  range.kernel = kernel;
+  range.data = data;
+  range.counter = &outstanding;
 
-    if (!victims)
-      // No work to steal.
-      return NULL;
+  if (Q == NULL) {
+    // Not the main thread or a worker, so hand the whole range off.
+    loom_handle_t task =
+      loom_describe_with_payload(&loom_parallel_for_kernel, (const void *)&range, sizeof(range), 0);
 
-    // Naively enumerating the work work queues introduces a bias toward
-    // earlier work queues and will more than likely cause cascading starvation
-    // of worker threads, degenerating scheduling into a free-for-all. To
-    // combat this, we rotate `victims` by a random amount and enumerate as we
-    // would normally, taking the rotation into count when selecting the work
-    // queue to victimize.
-    static const unsigned w = sizeof(victims) * CHAR_BIT;
-    const loom_native_t r = loom_prng_grab_u32(P) % w;
-    victims = (victims << r) | (victims >> ((-r) % w));
-
-    while (victims) {
-      const unsigned v = (loom_ctz_native(victims) + (w - r)) % w;
-
-      // Retry try a few times, in case of contention.
-      for (unsigned attempts = 0; attempts < 3; ++attempts)
-        if (loom_task_t *task = loom_work_queue_steal(S->queues[v]))
-          return task;
-
-    #if LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86
-      const loom_bool_t draining = ((offline & (1ul << v)) != 0) | (v == 0);
-    #elif LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64
-      const loom_bool_t draining = ((offline & (1ull << v)) != 0) | (v == 0);
-    #endif
+    kick(1, &task, &outstanding);
+  } else {
+    loom_parallel_for_range(&range);
+  }
 
-      if (draining)
-        if (loom_work_queue_is_empty(S->queues[v]))
-          // Drained all work from an offline worker's queue.
-          loom_atomic_reset_native(&S->work, v);
+  loom_wait_for_counter(&outstanding, 0);
+}
 
-      victims &= (victims - 1);
-    }
-  }
+// Rounds @size up to a whole number of cache lines, so partial results
+// written by different workers don't share any.
+static loom_size_t loom_stride_of_partials(loom_size_t size) {
+  return (size + LOOM_CACHE_LINE - 1) & ~((loom_size_t)LOOM_CACHE_LINE - 1);
 }
 
-static void loom_unblock_any_permitted(loom_task_t *task) {
-  // Tasks should not be modified by other threads once scheduled, so no race.
-  if (task->blocks > 0) {
-    loom_permit_t *permit = &task->permits[0];
+static loom_uint8_t *loom_partials_alloc(loom_size_t n,
+                                         loom_size_t stride,
+                                         loom_size_t size,
+                                         const void *identity) {
+  loom_uint8_t *partials =
+    (loom_uint8_t *)loom_memory_alloc(n * stride, LOOM_CACHE_LINE);
 
-    while (permit) {
-      if (loom_atomic_decr_u32(&permit->task->blockers) == 0) {
-        // Submit to this worker's queue.
-        loom_submit_a_task(permit->task);
-      }
+  for (loom_size_t partial = 0; partial < n; ++partial)
+    memcpy((void *)&partials[partial * stride], identity, size);
 
-      loom_permit_t *const next = permit->next;
-      loom_return_a_permit(permit);
-      permit = next;
-    }
-  }
+  return partials;
 }
 
-static void loom_schedule_a_task(loom_task_t *task) {
-  S->prologue.fn(task, S->prologue.context);
-
-  switch (task->work.kind) {
-    case LOOM_WORK_NONE:
-      // Do nothing.
-      break;
+typedef struct loom_reduction {
+  loom_reduce_fn reduce;
+  void *data;
 
-    case LOOM_WORK_CPU:
-      task->work.cpu.kernel(task->work.cpu.data);
-      break;
-  }
+  // A partial result for the main thread and each worker.
+  loom_uint8_t *partials;
+  loom_size_t stride;
+  loom_size_t threads;
+} loom_reduction_t;
 
-  S->epilogue.fn(task, S->epilogue.context);
+static void loom_parallel_reduce_kernel(loom_size_t begin,
+                                        loom_size_t end,
+                                        void *reduction_ptr) {
+  loom_reduction_t *reduction = (loom_reduction_t *)reduction_ptr;
 
-  if (task->barrier)
-    loom_atomic_decr_u32(task->barrier);
+  // Chunks only run on the main thread or workers, so each has a partial.
+  loom_assert_debug(q < reduction->threads);
 
-  loom_unblock_any_permitted(task);
+  void *partial = (void *)&reduction->partials[q * reduction->stride];
 
-  // TODO(mtwilliams): Copy to stack and return to pool immediately?
-  loom_return_a_task(task);
+  reduction->reduce(begin, end, partial, reduction->data);
 }
 
-static void loom_worker_thread(void *worker_ptr) {
-  loom_worker_t *worker = (loom_worker_t *)worker_ptr;
+void loom_parallel_reduce(loom_size_t begin,
+                          loom_size_t end,
+                          loom_size_t grain,
+                          loom_size_t size,
+                          const void *identity,
+                          loom_reduce_fn reduce,
+                          loom_combine_fn combine,
+                          void *data,
+                          void *result) {
+  // Workers aren't brought up or down while reducing, so this many suffice.
+  const loom_size_t threads = loom_atomic_load_u32(&S->n) + 1;
 
-  Q = S->queues[worker->id];
-  q = worker->id;
+  loom_reduction_t reduction;
 
-  if (P == NULL)
-    P = loom_prng_create();
+  reduction.reduce = reduce;
+  reduction.data = data;
+  reduction.stride = loom_stride_of_partials(size);
+  reduction.threads = threads;
+  reduction.partials = loom_partials_alloc(threads, reduction.stride, size, identity);
 
-startup:
-  loom_atomic_set_native(&S->online, q);
+  loom_parallel_for(begin, end, grain, &loom_parallel_reduce_kernel, (void *)&reduction);
 
-  while (1) {
-  waiting:
-    // Wait until there's work to steal, or a message to handle.
-    loom_event_t *events[2] = {S->message, S->work_to_steal};
-    switch (loom_event_wait_on_any(2, events, -1)) {
-      case 1:
-        if (loom_atomic_load_u32(&worker->shutdown))
-          goto shutdown;
-
-        // False wake up.
-        goto waiting;
-
-      case 2:
-        // Work to be stolen!
-        goto stealing;
-    }
+  memcpy(result, identity, size);
 
-  work_in_queue:
-    while (1) {
-      if (loom_atomic_load_u32(&worker->shutdown))
-        goto shutdown;
+  for (loom_size_t thread = 0; thread < threads; ++thread)
+    combine(result, (const void *)&reduction.partials[thread * reduction.stride], data);
 
-      if (loom_task_t *task = loom_grab_a_task())
-        loom_schedule_a_task(task);
-      else
-        goto exhausted;
-    }
+  loom_memory_free((void *)reduction.partials);
+}
 
-  exhausted:
-    // No work left in our queue.
-    loom_atomic_reset_native(&S->work, q);
+// Scans are split into a few blocks per thread, so that load imbalances can
+// be smoothed out by stealing.
+#define LOOM_SCAN_BLOCKS_PER_THREAD 4
 
-  stealing:
-    // Steal work until none is left at all.
-    while (1) {
-      if (loom_atomic_load_u32(&worker->shutdown))
-        goto shutdown;
+typedef struct loom_scan {
+  loom_reduce_fn reduce;
+  loom_scan_fn scan;
+  void *data;
 
-      if (loom_task_t *task = loom_steal_a_task())
-        loom_schedule_a_task(task);
-      else if (!loom_work_queue_is_empty(Q))
-        // Work in our queue.
-        goto work_in_queue;
-      else
-        goto waiting;
-    }
-  }
+  loom_size_t begin;
+  loom_size_t end;
+  loom_size_t block;
 
-shutdown:
-  loom_atomic_reset_native(&S->online, q);
+  // A partial result per block, followed by scratch space for two more.
+  loom_uint8_t *partials;
+  loom_size_t stride;
+} loom_scan_t;
 
-  // Let another thread drain our queue, or take over stealing work.
-  loom_signal_availability_of_work();
-}
+static void loom_parallel_scan_reduce_kernel(loom_size_t first,
+                                             loom_size_t last,
+                                             void *scan_ptr) {
+  loom_scan_t *scan = (loom_scan_t *)scan_ptr;
 
-// Returns the number of logical cores available.
-static loom_uint32_t number_of_cores(void) {
-#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
-  SYSTEM_INFO system_info;
-  GetNativeSystemInfo(&system_info);
-  return system_info.dwNumberOfProcessors;
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
-#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
-#endif
+  for (loom_size_t block = first; block < last; ++block) {
+    const loom_size_t begin = scan->begin + block * scan->block;
+    const loom_size_t end = (scan->end - begin > scan->block) ? begin + scan->block : scan->end;
+
+    scan->reduce(begin, end, (void *)&scan->partials[block * scan->stride], scan->data);
+  }
 }
 
-static loom_uint32_t choose_number_of_workers(loom_int32_t workers) {
-  if (workers < 0)
-    workers = number_of_cores() + workers;
+static void loom_parallel_scan_scan_kernel(loom_size_t first,
+                                           loom_size_t last,
+                                           void *scan_ptr) {
+  loom_scan_t *scan = (loom_scan_t *)scan_ptr;
 
-  if (workers >= LOOM_WORKER_LIMIT)
-    workers = LOOM_WORKER_LIMIT - 1;
+  for (loom_size_t block = first; block < last; ++block) {
+    const loom_size_t begin = scan->begin + block * scan->block;
+    const loom_size_t end = (scan->end - begin > scan->block) ? begin + scan->block : scan->end;
 
-  return workers;
+    scan->scan(begin, end, (const void *)&scan->partials[block * scan->stride], scan->data);
+  }
 }
 
-void loom_initialize(const loom_options_t *options) {
-  loom_assert_debug(options != NULL);
+void loom_parallel_scan(loom_size_t begin,
+                        loom_size_t end,
+                        loom_size_t grain,
+                        loom_size_t size,
+                        const void *identity,
+                        loom_reduce_fn reduce,
+                        loom_combine_fn combine,
+                        loom_scan_fn scan,
+                        void *data) {
+  loom_assert_debug(begin <= end);
 
-  // Prevent double initialization.
-  loom_assert_debug(S == NULL);
+  const loom_size_t n = end - begin;
 
-  S = loom_task_scheduler_create(options->tasks,
-                                 options->permits,
-                                 options->queue);
+  if (n == 0)
+    return;
 
-  if (options->prologue.fn)
-    S->prologue = options->prologue;
+  const loom_size_t threads = loom_atomic_load_u32(&S->n) + 1;
 
-  if (options->epilogue.fn)
-    S->epilogue = options->epilogue;
+  loom_size_t block = n / (threads * LOOM_SCAN_BLOCKS_PER_THREAD);
 
-  S->always_steal_from_main_thread = !options->main_thread_does_work;
+  if (block < grain)
+    block = grain;
 
-  const loom_uint32_t workers =
-    choose_number_of_workers(options->workers);
+  if (block == 0)
+    block = 1;
 
-  loom_bring_up_workers(workers);
+  const loom_size_t blocks = (n + block - 1) / block;
 
-  Q = S->queues[0];
-  q = 0;
+  loom_scan_t state;
 
-  if (P == NULL)
-    P = loom_prng_create();
-}
+  state.reduce = reduce;
+  state.scan = scan;
+  state.data = data;
+  state.begin = begin;
+  state.end = end;
+  state.block = block;
+  state.stride = loom_stride_of_partials(size);
+  state.partials = loom_partials_alloc(blocks + 2, state.stride, size, identity);
 
-void loom_shutdown(void) {
-  loom_assert_debug(S != NULL);
+  // Reduce each block independently.
+  loom_parallel_for(0, blocks, 1, &loom_parallel_scan_reduce_kernel, (void *)&state);
 
-  while (loom_atomic_load_native(&S->work))
-    if (!loom_do_some_work())
-      loom_thread_yield();
+  // Replace each block's reduction with the reduction of all blocks before
+  // it. There are only a handful of blocks per thread, so this is cheap.
+  void *carry = (void *)&state.partials[blocks * state.stride];
+  void *next = (void *)&state.partials[(blocks + 1) * state.stride];
 
-  loom_bring_down_workers(S->n);
+  for (loom_size_t b = 0; b < blocks; ++b) {
+    void *partial = (void *)&state.partials[b * state.stride];
 
-  loom_task_scheduler_destroy(S);
+    memcpy(next, (const void *)carry, size);
+    combine(next, (const void *)partial, data);
 
-  S = NULL;
-  Q = NULL;
-  q = 0;
-}
+    memcpy(partial, (const void *)carry, size);
+    memcpy(carry, (const void *)next, size);
+  }
 
-void loom_bring_up_workers(unsigned n) {
-  loom_lock_acquire(S->lock);
+  // Scan each block, seeded with everything before it.
+  loom_parallel_for(0, blocks, 1, &loom_parallel_scan_scan_kernel, (void *)&state);
 
-  // REFACTOR(mtwilliams): Silently limit?
-  loom_assert_debug(S->n + n <= LOOM_WORKER_LIMIT);
+  loom_memory_free((void *)state.partials);
+}
 
-  for (unsigned worker = S->n; n > 0; --n, ++worker) {
-    // Make sure not already online.
-    loom_assert_debug(S->workers[worker].thread == NULL);
+loom_graph_t *loom_graph_create(void) {
+  loom_graph_t *graph = (loom_graph_t *)calloc(1, sizeof(loom_graph_t));
 
-    loom_thread_options_t worker_thread_options;
+  graph->outstanding.value = 0;
+  graph->outstanding.target = 0;
+  graph->outstanding.waiting = NULL;
 
-    char worker_thread_name[17];
-    snprintf(&worker_thread_name[0], 16, "Worker %02u", worker + 1);
-    worker_thread_name[16] = '\0';
+  return graph;
+}
 
-    worker_thread_options.name = &worker_thread_name[0];
+void loom_graph_destroy(loom_graph_t *graph) {
+  free((void *)graph->nodes);
+  free((void *)graph->edges);
 
-  #if LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86
-    worker_thread_options.affinity = (1ul << worker);
-  #elif LOOM_ARCHITECTURE == LOOM_ARCHITECTURE_X86_64
-    worker_thread_options.affinity = (1ull << worker);
-  #endif
+  if (graph->tasks)
+    loom_memory_free((void *)graph->tasks);
 
-    worker_thread_options.stack = 0;
+  free((void *)graph->predecessors);
+  free((void *)graph->offsets);
+  free((void *)graph->successors);
+  free((void *)graph->roots);
 
-    if (S->queues[worker + 1] == NULL)
-      S->queues[worker + 1] = loom_work_queue_create(S->size_of_each_work_queue);
+  free((void *)graph);
+}
 
-    S->workers[worker].thread = loom_thread_spawn(&loom_worker_thread,
-                                                  (void *)&S->workers[worker],
-                                                  &worker_thread_options);
+loom_uint32_t loom_graph_add(loom_graph_t *graph,
+                             loom_kernel_fn kernel,
+                             void *data,
+                             loom_uint32_t flags) {
+  loom_assert_debug(!graph->compiled);
 
-    S->n += 1;
+  if (graph->number_of_nodes == graph->capacity_of_nodes) {
+    graph->capacity_of_nodes = graph->capacity_of_nodes ? graph->capacity_of_nodes * 2 : 64;
+    graph->nodes = (loom_graph_node_t *)realloc((void *)graph->nodes, graph->capacity_of_nodes * sizeof(loom_graph_node_t));
   }
 
-  loom_lock_release(S->lock);
-}
+  loom_graph_node_t *node = &graph->nodes[graph->number_of_nodes];
 
-void loom_bring_down_workers(unsigned n) {
-  loom_lock_acquire(S->lock);
+  node->kernel = kernel;
+  node->data = data;
+  node->flags = flags;
 
-  // REFACTOR(mtwilliams): Silently limit?
-  loom_assert_debug(S->n >= n);
+  return graph->number_of_nodes++;
+}
 
-  // Post shutdown messages.
-  for (unsigned worker = S->n; worker > S->n - n; --worker) {
-    // Make sure not already offline.
-    loom_assert_debug(S->workers[worker - 1].thread != NULL);
+void loom_graph_add_edge(loom_graph_t *graph,
+                         loom_uint32_t from,
+                         loom_uint32_t to) {
+  loom_assert_debug(!graph->compiled);
+  loom_assert_debug(from < graph->number_of_nodes);
+  loom_assert_debug(to < graph->number_of_nodes);
 
-    // Flag for shutdown.
-    loom_atomic_store_u32(&S->workers[worker - 1].shutdown, 1);
+  if (graph->number_of_edges == graph->capacity_of_edges) {
+    graph->capacity_of_edges = graph->capacity_of_edges ? graph->capacity_of_edges * 2 : 64;
+    graph->edges = (loom_graph_edge_t *)realloc((void *)graph->edges, graph->capacity_of_edges * sizeof(loom_graph_edge_t));
   }
 
-  // Wait until acknowledged.
-  loom_event_signal(S->message);
+  loom_graph_edge_t *edge = &graph->edges[graph->number_of_edges++];
 
-  for (unsigned worker = S->n; n > 0; --n, --worker) {
-    loom_thread_join(S->workers[worker - 1].thread);
+  edge->from = from;
+  edge->to = to;
+}
 
-    // No longer any associated worker thread.
-    S->workers[worker - 1].thread = NULL;
+// Walks @graph in topological order. Returns false if any node is never
+// reached, as it's part of or behind a cycle.
+static loom_bool_t loom_graph_is_acyclic(const loom_graph_t *graph) {
+  const loom_uint32_t n = graph->n;
 
-    // Prevent shutdown if brought up again.
-    loom_atomic_store_u32(&S->workers[worker - 1].shutdown, 0);
+  loom_uint32_t *blockers = (loom_uint32_t *)calloc(n + 1, sizeof(loom_uint32_t));
+  loom_uint32_t *order = (loom_uint32_t *)calloc(n + 1, sizeof(loom_uint32_t));
 
-    S->n -= 1;
+  memcpy((void *)blockers, (const void *)graph->predecessors, n * sizeof(loom_uint32_t));
+
+  loom_uint32_t ordered = 0;
+
+  for (loom_uint32_t node = 0; node < n; ++node)
+    if (blockers[node] == 0)
+      order[ordered++] = node;
+
+  for (loom_uint32_t visited = 0; visited < ordered; ++visited) {
+    const loom_uint32_t node = order[visited];
+
+    for (loom_uint32_t edge = graph->offsets[node]; edge < graph->offsets[node + 1]; ++edge)
+      if (--blockers[graph->successors[edge]] == 0)
+        order[ordered++] = graph->successors[edge];
   }
 
-  loom_event_unsignal(S->message);
+  free((void *)blockers);
+  free((void *)order);
 
-  loom_lock_release(S->lock);
+  return (ordered == n);
 }
 
-static loom_handle_t task_to_handle(loom_task_t *task) {
-  loom_handle_t handle;
+loom_bool_t loom_graph_compile(loom_graph_t *graph) {
+  loom_assert_debug(!graph->compiled);
 
-#if LOOM_CONFIGURATION == LOOM_CONFIGURATION_DEBUG
-  handle.index = task - S->tasks->tasks;
-  handle.id = task->id;
-#else
-  handle.opaque = (void *)task;
-#endif
+  const loom_uint32_t n = graph->number_of_nodes;
 
-  return handle;
-}
+  graph->n = n;
 
-static loom_task_t *handle_to_task(loom_handle_t handle) {
-#if LOOM_CONFIGURATION == LOOM_CONFIGURATION_DEBUG
-  loom_task_t *task = &S->tasks->tasks[handle.index];
-  loom_assert_debug(task->id == handle.id);
-  return task;
-#else
-  return (loom_task_t *)handle.opaque;
-#endif
-}
+  graph->predecessors = (loom_uint32_t *)calloc(n + 1, sizeof(loom_uint32_t));
+  graph->offsets = (loom_uint32_t *)calloc(n + 1, sizeof(loom_uint32_t));
+  graph->successors = (loom_uint32_t *)calloc(graph->number_of_edges + 1, sizeof(loom_uint32_t));
 
-loom_handle_t loom_empty(loom_uint32_t flags) {
-  loom_task_t *task = loom_acquire_a_task();
+  // Count, then lay out, successors.
+  for (loom_uint32_t edge = 0; edge < graph->number_of_edges; ++edge) {
+    graph->offsets[graph->edges[edge].from + 1] += 1;
+    graph->predecessors[graph->edges[edge].to] += 1;
+  }
 
-  task->flags = flags;
+  for (loom_uint32_t node = 0; node < n; ++node)
+    graph->offsets[node + 1] += graph->offsets[node];
 
-  task->work.kind = LOOM_WORK_NONE;
+  loom_uint32_t *cursors = (loom_uint32_t *)calloc(n + 1, sizeof(loom_uint32_t));
 
-  memset((void *)&task->permits[0], 0, LOOM_EMBEDDED_PERMITS * sizeof(loom_permit_t));
+  memcpy((void *)cursors, (const void *)graph->offsets, (n + 1) * sizeof(loom_uint32_t));
 
-  task->blocks = 0;
-  task->blockers = 0;
+  for (loom_uint32_t edge = 0; edge < graph->number_of_edges; ++edge)
+    graph->successors[cursors[graph->edges[edge].from]++] = graph->edges[edge].to;
 
-  task->barrier = NULL;
+  free((void *)cursors);
 
-  return task_to_handle(task);
-}
+  if (!loom_graph_is_acyclic(graph)) {
+    // Replays would never complete. Leave it as recorded.
+    free((void *)graph->predecessors);
+    free((void *)graph->offsets);
+    free((void *)graph->successors);
 
-loom_handle_t loom_describe(loom_kernel_fn kernel,
-                            void *data,
-                            loom_uint32_t flags) {
-  loom_task_t *task = loom_acquire_a_task();
+    graph->predecessors = NULL;
+    graph->offsets = NULL;
+    graph->successors = NULL;
 
-  task->flags = flags;
+    graph->n = 0;
 
-  task->work.kind = LOOM_WORK_CPU;
-  task->work.cpu.kernel = kernel;
-  task->work.cpu.data = data;
+    return false;
+  }
 
-  memset((void *)&task->permits[0], 0, LOOM_EMBEDDED_PERMITS * sizeof(loom_permit_t));
+  graph->roots = (loom_uint32_t *)calloc(n + 1, sizeof(loom_uint32_t));
+  graph->number_of_roots = 0;
 
-  task->blocks = 0;
-  task->blockers = 0;
+  for (loom_uint32_t node = 0; node < n; ++node)
+    if (graph->predecessors[node] == 0)
+      graph->roots[graph->number_of_roots++] = node;
 
-  task->barrier = NULL;
+  graph->tasks = (loom_task_t *)loom_memory_alloc((n ? n : 1) * sizeof(loom_task_t), LOOM_CACHE_LINE);
 
-  return task_to_handle(task);
-}
+  for (loom_uint32_t node = 0; node < n; ++node) {
+    loom_task_t *task = &graph->tasks[node];
 
-static void permit(loom_task_t *task,
-                   loom_task_t *permitee) {
-  loom_permit_t *permit = loom_acquire_a_permit(task);
+    task->flags = graph->nodes[node].flags | LOOM_TASK_RECORDED;
 
-  permit->next = NULL;
-  permit->task = permitee;
+    task->work.kind = LOOM_WORK_CPU;
+    task->work.cpu.kernel = graph->nodes[node].kernel;
+    task->work.cpu.data = graph->nodes[node].data;
 
-  loom_atomic_incr_u32(&permitee->blockers);
-}
+    task->permits = NULL;
 
-void loom_permits(loom_handle_t task,
-                  loom_handle_t permitee) {
-  permit(handle_to_task(task), handle_to_task(permitee));
-}
+    task->counter = &graph->outstanding;
 
-void loom_kick(loom_handle_t task) {
-  loom_kick_n(1, &task);
-}
+    task->fiber = NULL;
 
-void loom_kick_n(unsigned n, const loom_handle_t *tasks) {
-  for (unsigned i = 0; i < n; ++i) {
-    loom_task_t *task = handle_to_task(tasks[i]);
-    loom_submit_a_task(task);
+    task->id = node;
+    task->index = node;
+
+    task->payload.__alignment_of_pointer__ = (void *)graph;
   }
-}
 
-void loom_kick_and_wait(loom_handle_t task) {
-  loom_kick_and_wait_n(1, &task);
-}
+  free((void *)graph->nodes);
+  free((void *)graph->edges);
 
-static loom_bool_t is_zero_yet(volatile loom_uint32_t *v) {
-  return (loom_atomic_load_u32(v) == 0)
-      && (loom_atomic_cmp_and_xchg_u32(v, 0, 0) == 0);
-}
+  graph->nodes = NULL;
+  graph->edges = NULL;
 
-static void kick(unsigned n, const loom_handle_t *tasks, loom_uint32_t *barrier) {
-  for (unsigned i = 0; i < n; ++i) {
-    loom_task_t *task = handle_to_task(tasks[i]);
-    task->barrier = barrier;
-  }
+  graph->compiled = true;
 
-  for (unsigned i = 0; i < n; ++i) {
-    loom_task_t *task = handle_to_task(tasks[i]);
-    loom_submit_a_task(task);
-  }
+  return true;
 }
 
-void loom_kick_and_wait_n(unsigned n, const loom_handle_t *tasks) {
-  loom_uint32_t outstanding = n;
+void loom_graph_replay(loom_graph_t *graph) {
+  loom_assert_debug(graph->compiled);
 
-  kick(n, tasks, &outstanding);
+  // Replays can't overlap.
+  loom_assert_debug(loom_counter_value(&graph->outstanding) == 0);
 
-  while (!is_zero_yet(&outstanding))
-    loom_thread_yield();
+  if (graph->n == 0)
+    return;
+
+  for (loom_uint32_t node = 0; node < graph->n; ++node)
+    graph->tasks[node].blockers = graph->predecessors[node];
+
+  loom_atomic_fetch_and_add_u32(&graph->outstanding.value, graph->n);
+
+  for (loom_uint32_t root = 0; root < graph->number_of_roots; ++root)
+    loom_submit_a_task(&graph->tasks[graph->roots[root]]);
+
+  loom_wait_for_counter(&graph->outstanding, 0);
 }
 
-void loom_kick_and_do_work_while_waiting(loom_handle_t task) {
-  loom_kick_and_do_work_while_waiting_n(1, &task);
+void loom_kick_and_wait_with_arena_n(unsigned n,
+                                     const loom_handle_t *tasks,
+                                     loom_arena_t *arena) {
+  loom_kick_and_wait_n(n, tasks);
+  loom_arena_reset(arena);
 }
 
-void loom_kick_and_do_work_while_waiting_n(unsigned n,
-                                           const loom_handle_t *tasks) {
-  loom_uint32_t outstanding = n;
+void loom_kick_and_do_work_while_waiting_with_arena_n(unsigned n,
+                                                      const loom_handle_t *tasks,
+                                                      loom_arena_t *arena) {
+  loom_kick_and_do_work_while_waiting_n(n, tasks);
+  loom_arena_reset(arena);
+}
 
-  kick(n, tasks, &outstanding);
+void loom_idle_statistics(loom_idle_statistics_t *statistics) {
+  loom_assert_debug(statistics != NULL);
 
-  while (!is_zero_yet(&outstanding))
-    if (!loom_do_some_work())
-      loom_thread_yield();
+  statistics->spinning = 0;
+  statistics->yielding = 0;
+  statistics->parked = 0;
+
+  for (unsigned worker = 0; worker < LOOM_WORKER_LIMIT; ++worker) {
+    statistics->spinning += S->workers[worker].statistics.spinning;
+    statistics->yielding += S->workers[worker].statistics.yielding;
+    statistics->parked += S->workers[worker].statistics.parked;
+  }
 }
 
 loom_bool_t loom_do_some_work(void) {
   loom_assert_debug(q == 0);
+  loom_assert_debug(Q != NULL);
 
-  if (loom_task_t *task = loom_grab_a_task()) {
-    loom_schedule_a_task(task);
-    return true;
-  }
-
-  if (loom_task_t *task = loom_steal_a_task()) {
+  if (loom_task_t *task = loom_find_a_task()) {
     loom_schedule_a_task(task);
     return true;
   }
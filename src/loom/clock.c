@@ -0,0 +1,50 @@
+//===-- loom/clock.c ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#include "loom/clock.h"
+
+#include "loom/support.h"
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  #include <windows.h>
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+  #include <mach/mach_time.h>
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  #include <time.h>
+#endif
+
+LOOM_BEGIN_EXTERN_C
+
+loom_uint64_t loom_clock_now(void) {
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+
+  // Split to avoid overflow.
+  const loom_uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+  const loom_uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+
+  return seconds * 1000000000ull + (remainder * 1000000000ull) / frequency.QuadPart;
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+
+  return (mach_absolute_time() * timebase.numer) / timebase.denom;
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (loom_uint64_t)now.tv_sec * 1000000000ull + (loom_uint64_t)now.tv_nsec;
+#endif
+}
+
+LOOM_END_EXTERN_C
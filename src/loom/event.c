@@ -13,17 +13,31 @@
 
 #include "loom/support.h"
 
+#include <stdlib.h>
+
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   #include <windows.h>
 #endif
 
+#if LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  #include "loom/atomics.h"
+  #include "loom/futex.h"
+#endif
+
 LOOM_BEGIN_EXTERN_C
 
 struct loom_event {
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   HANDLE handle;
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // Non-zero while signaled. Doubles as the futex that waiters block on.
+  loom_uint32_t state;
+
+  // Number of threads blocked on `state`, so we only wake when needed.
+  loom_uint32_t waiters;
+
+  loom_bool_t manual;
 #endif
 };
 
@@ -35,14 +49,57 @@ struct loom_event {
   }
 #endif
 
+#if LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // Futexes can't wait on more than one address at a time, so threads waiting
+  // on any of multiple events wait on this sequence instead. It's bumped
+  // whenever any event is signaled while any such thread is waiting.
+  static loom_uint32_t any_sequence = 0;
+  static loom_uint32_t any_waiters = 0;
+
+  // Consumes a signal, unless @event is manually reset.
+  static loom_bool_t try_to_consume(loom_event_t *event) {
+    if (event->manual)
+      return loom_atomic_load_u32(&event->state) != 0;
+    return loom_atomic_cmp_and_xchg_u32(&event->state, 1, 0) == 1;
+  }
+
+  static loom_bool_t wait_until(loom_event_t *event, loom_uint64_t deadline) {
+    while (!try_to_consume(event)) {
+      loom_atomic_incr_u32(&event->waiters);
+
+      // Returns immediately if signaled after we checked, so we never miss a
+      // signal.
+      const loom_bool_t expired = !loom_futex_wait(&event->state, 0, deadline);
+
+      loom_atomic_decr_u32(&event->waiters);
+
+      if (expired)
+        return try_to_consume(event);
+    }
+
+    return true;
+  }
+
+  static unsigned try_to_consume_any(unsigned n, loom_event_t **events) {
+    for (unsigned event = 0; event < n; ++event)
+      if (try_to_consume(events[event]))
+        return event + 1;
+
+    return 0;
+  }
+#endif
+
 loom_event_t *loom_event_create(loom_bool_t manual) {
   loom_event_t *event =
     (loom_event_t *)calloc(1, sizeof(loom_event_t));
 
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   event->handle = CreateEvent(NULL, manual, FALSE, NULL);
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  event->state = 0;
+  event->waiters = 0;
+  event->manual = manual;
 #endif
 
   return event;
@@ -53,8 +110,9 @@ void loom_event_destroy(loom_event_t *event) {
 
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   CloseHandle(event->handle);
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // Nothing to do.
 #endif
 
   free((void *)event);
@@ -65,8 +123,21 @@ void loom_event_signal(loom_event_t *event) {
 
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   SetEvent(event->handle);
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  loom_atomic_xchg_u32(&event->state, 1);
+
+  if (loom_atomic_load_u32(&event->waiters)) {
+    if (event->manual)
+      loom_futex_wake_all(&event->state);
+    else
+      loom_futex_wake(&event->state, 1);
+  }
+
+  if (loom_atomic_load_u32(&any_waiters)) {
+    loom_atomic_incr_u32(&any_sequence);
+    loom_futex_wake_all(&any_sequence);
+  }
 #endif
 }
 
@@ -75,8 +146,9 @@ void loom_event_unsignal(loom_event_t *event) {
   
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   ResetEvent(event->handle);
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  loom_atomic_xchg_u32(&event->state, 0);
 #endif
 }
 
@@ -86,8 +158,9 @@ loom_bool_t loom_event_wait(loom_event_t *event,
   
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   return (WaitForSingleObject(event->handle, timeout_to_windows(timeout)) == WAIT_OBJECT_0);
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  return wait_until(event, loom_futex_deadline(timeout));
 #endif
 }
 
@@ -119,8 +192,32 @@ unsigned loom_event_wait_on_any(unsigned n,
     return (result - WAIT_OBJECT_0) + 1;
 
   return 0;
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  const loom_uint64_t deadline = loom_futex_deadline(timeout);
+
+  while (1) {
+    if (const unsigned signaled = try_to_consume_any(n, events))
+      return signaled;
+
+    loom_atomic_incr_u32(&any_waiters);
+
+    // Sample the sequence after registering but before checking again, so
+    // any signal after our check bumps it and prevents us from sleeping.
+    const loom_uint32_t sequence = loom_atomic_load_u32(&any_sequence);
+
+    if (const unsigned signaled = try_to_consume_any(n, events)) {
+      loom_atomic_decr_u32(&any_waiters);
+      return signaled;
+    }
+
+    const loom_bool_t expired = !loom_futex_wait(&any_sequence, sequence, deadline);
+
+    loom_atomic_decr_u32(&any_waiters);
+
+    if (expired)
+      return try_to_consume_any(n, events);
+  }
 #endif
 }
 
@@ -137,8 +234,16 @@ loom_bool_t loom_event_wait_on_all(unsigned n,
     return false;
 
   return true;
-#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
-      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // Unlike Windows, we consume signals as we go rather than all at once.
+  const loom_uint64_t deadline = loom_futex_deadline(timeout);
+
+  for (unsigned event = 0; event < n; ++event)
+    if (!wait_until(events[event], deadline))
+      return false;
+
+  return true;
 #endif
 }
 
@@ -0,0 +1,140 @@
+//===-- loom/fiber.c ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#include "loom/fiber.h"
+
+#include "loom/support.h"
+
+#if LOOM_FIBERS
+  #include <unistd.h>
+  #include <sys/mman.h>
+#endif
+
+LOOM_BEGIN_EXTERN_C
+
+#if LOOM_FIBERS
+
+// Saves callee-saved registers and control words to the current stack, swaps
+// stacks, then restores the same from the new stack. Contexts are laid out
+// (from low to high) as:
+//
+//   [mxcsr, x87 control word] r15 r14 r13 r12 rbx rbp [return address]
+//
+asm(
+  ".text\n"
+  ".globl loom_fiber_switch\n"
+  ".hidden loom_fiber_switch\n"
+  ".type loom_fiber_switch, @function\n"
+  "loom_fiber_switch:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  ldmxcsr (%rsp)\n"
+  "  fldcw 4(%rsp)\n"
+  "  addq $8, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size loom_fiber_switch, .-loom_fiber_switch\n"
+);
+
+// Fresh contexts "return" here, with the argument and entry point stashed in
+// callee-saved registers by `loom_fiber_prepare`. The stack is aligned as if
+// we were about to make a call, as the ABI requires.
+void loom_fiber_start(void);
+
+asm(
+  ".text\n"
+  ".type loom_fiber_start, @function\n"
+  "loom_fiber_start:\n"
+  "  movq %r12, %rdi\n"
+  "  callq *%r13\n"
+  "  ud2\n"
+  ".size loom_fiber_start, .-loom_fiber_start\n"
+);
+
+static loom_size_t loom_fiber_page_size(void) {
+  return (loom_size_t)sysconf(_SC_PAGESIZE);
+}
+
+static loom_size_t loom_fiber_round_to_pages(loom_size_t size) {
+  const loom_size_t page = loom_fiber_page_size();
+  return (size + page - 1) & ~(page - 1);
+}
+
+void *loom_fiber_stack_alloc(loom_size_t size) {
+  const loom_size_t page = loom_fiber_page_size();
+
+  size = loom_fiber_round_to_pages(size);
+
+  // Stacks are only committed as they're touched, so unused stack costs
+  // nothing but address space.
+  loom_uint8_t *mapping = (loom_uint8_t *)mmap(NULL, size + page,
+                                               PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                               -1, 0);
+
+  if (mapping == (loom_uint8_t *)MAP_FAILED)
+    return NULL;
+
+  // Stacks grow down, so the guard goes below.
+  mprotect((void *)mapping, page, PROT_NONE);
+
+  return (void *)(mapping + page);
+}
+
+void loom_fiber_stack_free(void *stack,
+                           loom_size_t size) {
+  const loom_size_t page = loom_fiber_page_size();
+
+  size = loom_fiber_round_to_pages(size);
+
+  munmap((void *)((loom_uint8_t *)stack - page), size + page);
+}
+
+loom_fiber_context_t loom_fiber_prepare(void *stack,
+                                        loom_size_t size,
+                                        loom_fiber_entry_fn entry,
+                                        void *argument) {
+  loom_native_t top = ((loom_native_t)stack + size) & ~(loom_native_t)15;
+
+  loom_uint64_t *context = (loom_uint64_t *)top - 8;
+
+  // Default MXCSR in the low half, and default x87 control word in the high.
+  context[0] = 0x1f80ull | (0x037full << 32);
+
+  context[1] = 0;                            // r15
+  context[2] = 0;                            // r14
+  context[3] = (loom_uint64_t)entry;         // r13
+  context[4] = (loom_uint64_t)argument;      // r12
+  context[5] = 0;                            // rbx
+  context[6] = 0;                            // rbp
+
+  context[7] = (loom_uint64_t)&loom_fiber_start;
+
+  return (loom_fiber_context_t)context;
+}
+
+#endif
+
+LOOM_END_EXTERN_C
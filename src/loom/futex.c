@@ -0,0 +1,119 @@
+//===-- loom/futex.c ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#include "loom/futex.h"
+
+#include "loom/support.h"
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  #include <windows.h>
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  #include <limits.h>
+  #include <errno.h>
+  #include <time.h>
+  #include <unistd.h>
+  #include <sys/syscall.h>
+  #include <linux/futex.h>
+#endif
+
+LOOM_BEGIN_EXTERN_C
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+
+loom_uint64_t loom_futex_deadline(unsigned timeout) {
+  if (timeout == (unsigned)-1)
+    return LOOM_FUTEX_FOREVER;
+
+  return (GetTickCount64() + (loom_uint64_t)timeout) * 1000000ull;
+}
+
+loom_bool_t loom_futex_wait(volatile loom_uint32_t *address,
+                            loom_uint32_t expected,
+                            loom_uint64_t deadline) {
+  DWORD timeout = INFINITE;
+
+  if (deadline != LOOM_FUTEX_FOREVER) {
+    const loom_uint64_t now = GetTickCount64() * 1000000ull;
+
+    if (now >= deadline)
+      return false;
+
+    // Rounded up, so we never wake before the deadline.
+    timeout = (DWORD)((deadline - now + 999999ull) / 1000000ull);
+  }
+
+  if (WaitOnAddress(address, (PVOID)&expected, sizeof(expected), timeout))
+    return true;
+
+  return (GetLastError() != ERROR_TIMEOUT);
+}
+
+void loom_futex_wake(volatile loom_uint32_t *address,
+                     unsigned n) {
+  // Waking more than asked for is harmless, as wakeups may be spurious.
+  if (n == 1)
+    WakeByAddressSingle((PVOID)address);
+  else
+    WakeByAddressAll((PVOID)address);
+}
+
+void loom_futex_wake_all(volatile loom_uint32_t *address) {
+  WakeByAddressAll((PVOID)address);
+}
+
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+
+loom_uint64_t loom_futex_deadline(unsigned timeout) {
+  if (timeout == (unsigned)-1)
+    return LOOM_FUTEX_FOREVER;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (loom_uint64_t)now.tv_sec * 1000000000ull
+       + (loom_uint64_t)now.tv_nsec
+       + (loom_uint64_t)timeout * 1000000ull;
+}
+
+loom_bool_t loom_futex_wait(volatile loom_uint32_t *address,
+                            loom_uint32_t expected,
+                            loom_uint64_t deadline) {
+  struct timespec absolute;
+  struct timespec *timeout = NULL;
+
+  if (deadline != LOOM_FUTEX_FOREVER) {
+    absolute.tv_sec = (time_t)(deadline / 1000000000ull);
+    absolute.tv_nsec = (long)(deadline % 1000000000ull);
+    timeout = &absolute;
+  }
+
+  // We use `FUTEX_WAIT_BITSET` rather than `FUTEX_WAIT` as it takes an
+  // absolute timeout against the monotonic clock, so spurious wakeups don't
+  // extend how long we wait.
+  const long result = syscall(SYS_futex, (void *)address,
+                              FUTEX_WAIT_BITSET_PRIVATE, expected,
+                              timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+
+  return (result == 0) || (errno != ETIMEDOUT);
+}
+
+void loom_futex_wake(volatile loom_uint32_t *address,
+                     unsigned n) {
+  syscall(SYS_futex, (void *)address, FUTEX_WAKE_PRIVATE, (int)n, NULL, NULL, 0);
+}
+
+void loom_futex_wake_all(volatile loom_uint32_t *address) {
+  loom_futex_wake(address, INT_MAX);
+}
+
+#endif
+
+LOOM_END_EXTERN_C
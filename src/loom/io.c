@@ -0,0 +1,410 @@
+//===-- loom/io.c ------------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#include "loom/io.h"
+
+#include "loom/support.h"
+#include "loom/atomics.h"
+#include "loom/lock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <unistd.h>
+#endif
+
+#if LOOM_IO_URING
+  // We call into io_uring directly rather than depend on `liburing`.
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <linux/io_uring.h>
+#endif
+
+LOOM_BEGIN_EXTERN_C
+
+#if LOOM_IO_URING
+
+struct loom_io_ring {
+  int fd;
+
+  // Submission queue, shared with the kernel.
+  volatile unsigned *sq_head;
+  volatile unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+
+  // Completion queue, shared with the kernel.
+  volatile unsigned *cq_head;
+  volatile unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  // Mappings, so we can unmap them.
+  void *sq_ring;
+  loom_size_t sq_ring_size;
+  void *cq_ring;
+  loom_size_t cq_ring_size;
+  loom_size_t sqes_size;
+
+  // Held while submitting and reaping, respectively.
+  loom_lock_t *submitting;
+  loom_lock_t *reaping;
+};
+
+static int loom_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int loom_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int loom_io_uring_register(int fd, unsigned opcode, void *arg, unsigned n) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, n);
+}
+
+// Checks the kernel supports every operation we submit, as plain reads and
+// writes only arrived in 5.6.
+static loom_bool_t loom_io_ring_supports_what_we_need(int fd) {
+  const loom_size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+
+  struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, size);
+
+  loom_bool_t supported = false;
+
+  if (loom_io_uring_register(fd, IORING_REGISTER_PROBE, (void *)probe, 256) == 0) {
+    supported = (probe->last_op >= IORING_OP_WRITE)
+             && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+             && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)
+             && (probe->ops[IORING_OP_FSYNC].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  free((void *)probe);
+
+  return supported;
+}
+
+static void *loom_io_ring_map(int fd, loom_size_t size, loom_uint64_t offset) {
+  void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, (off_t)offset);
+
+  return (mapping == MAP_FAILED) ? NULL : mapping;
+}
+
+loom_io_ring_t *loom_io_ring_create(unsigned entries) {
+  struct io_uring_params params;
+  memset((void *)&params, 0, sizeof(params));
+
+  // Not available if the kernel is too old, or we're sandboxed.
+  const int fd = loom_io_uring_setup(entries, &params);
+
+  if (fd < 0)
+    return NULL;
+
+  if (!loom_io_ring_supports_what_we_need(fd)) {
+    close(fd);
+    return NULL;
+  }
+
+  loom_io_ring_t *ring = (loom_io_ring_t *)calloc(1, sizeof(loom_io_ring_t));
+
+  ring->fd = fd;
+
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    // Both rings share a mapping.
+    if (ring->cq_ring_size > ring->sq_ring_size)
+      ring->sq_ring_size = ring->cq_ring_size;
+
+    ring->sq_ring = loom_io_ring_map(fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->sq_ring = loom_io_ring_map(fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = loom_io_ring_map(fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+  }
+
+  ring->sqes = (struct io_uring_sqe *)loom_io_ring_map(fd, ring->sqes_size, IORING_OFF_SQES);
+
+  if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) {
+    loom_io_ring_destroy(ring);
+    return NULL;
+  }
+
+  loom_uint8_t *sq = (loom_uint8_t *)ring->sq_ring;
+  loom_uint8_t *cq = (loom_uint8_t *)ring->cq_ring;
+
+  ring->sq_head = (volatile unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (volatile unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+
+  ring->cq_head = (volatile unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (volatile unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  ring->submitting = loom_lock_create();
+  ring->reaping = loom_lock_create();
+
+  return ring;
+}
+
+void loom_io_ring_destroy(loom_io_ring_t *ring) {
+  if (ring->sqes)
+    munmap((void *)ring->sqes, ring->sqes_size);
+
+  if (ring->cq_ring && (ring->cq_ring != ring->sq_ring))
+    munmap(ring->cq_ring, ring->cq_ring_size);
+
+  if (ring->sq_ring)
+    munmap(ring->sq_ring, ring->sq_ring_size);
+
+  if (ring->submitting)
+    loom_lock_destroy(ring->submitting);
+
+  if (ring->reaping)
+    loom_lock_destroy(ring->reaping);
+
+  close(ring->fd);
+
+  free((void *)ring);
+}
+
+static const loom_uint8_t loom_io_ring_opcodes[] = {
+  /* LOOM_IO_RING_READ  = */ IORING_OP_READ,
+  /* LOOM_IO_RING_WRITE = */ IORING_OP_WRITE,
+  /* LOOM_IO_RING_FSYNC = */ IORING_OP_FSYNC,
+  /* LOOM_IO_RING_NOP   = */ IORING_OP_NOP
+};
+
+loom_bool_t loom_io_ring_submit(loom_io_ring_t *ring,
+                                loom_uint32_t op,
+                                loom_int32_t fd,
+                                void *buffer,
+                                loom_size_t size,
+                                loom_uint64_t offset,
+                                void *user) {
+  loom_lock_acquire(ring->submitting);
+
+  const unsigned tail = *ring->sq_tail;
+  const unsigned head = loom_atomic_load_u32((const volatile loom_uint32_t *)ring->sq_head);
+
+  if ((tail - head) >= ring->sq_entries) {
+    // Full.
+    loom_lock_release(ring->submitting);
+    return false;
+  }
+
+  const unsigned index = tail & ring->sq_mask;
+
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+
+  memset((void *)sqe, 0, sizeof(*sqe));
+
+  sqe->opcode = loom_io_ring_opcodes[op];
+  sqe->fd = fd;
+  sqe->addr = (loom_uint64_t)buffer;
+  sqe->len = (loom_uint32_t)size;
+  sqe->off = offset;
+  sqe->user_data = (loom_uint64_t)user;
+
+  ring->sq_array[index] = index;
+
+  // Ensure the entry is written prior to the kernel seeing it.
+  loom_atomic_barrier();
+
+  loom_atomic_store_u32((volatile loom_uint32_t *)ring->sq_tail, tail + 1);
+
+  // Submit anything the kernel hasn't consumed, which includes anything left
+  // behind by a failed submission.
+  const unsigned pending = (tail + 1) - loom_atomic_load_u32((const volatile loom_uint32_t *)ring->sq_head);
+
+  while (loom_io_uring_enter(ring->fd, pending, 0, 0) < 0)
+    if (errno != EINTR)
+      // The kernel can't take it right now, usually because completions have
+      // backed up. It'll be submitted along with whatever comes next, or by
+      // whoever waits on the ring.
+      break;
+
+  loom_lock_release(ring->submitting);
+
+  return true;
+}
+
+loom_bool_t loom_io_ring_any_completed(const loom_io_ring_t *ring) {
+  return loom_atomic_load_u32((const volatile loom_uint32_t *)ring->cq_tail) != *ring->cq_head;
+}
+
+unsigned loom_io_ring_reap(loom_io_ring_t *ring,
+                           loom_io_completion_t *completions,
+                           unsigned n) {
+  if (!loom_io_ring_any_completed(ring))
+    return 0;
+
+  loom_lock_acquire(ring->reaping);
+
+  unsigned head = *ring->cq_head;
+  const unsigned tail = loom_atomic_load_u32((const volatile loom_uint32_t *)ring->cq_tail);
+
+  // Ensure we don't read entries prior to the tail.
+  loom_atomic_acquire();
+
+  unsigned reaped = 0;
+
+  while ((head != tail) && (reaped < n)) {
+    const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+
+    completions[reaped].user = (void *)cqe->user_data;
+    completions[reaped].result = cqe->res;
+
+    head += 1;
+    reaped += 1;
+  }
+
+  // Ensure entries are read prior to the kernel reusing them.
+  loom_atomic_barrier();
+
+  loom_atomic_store_u32((volatile loom_uint32_t *)ring->cq_head, head);
+
+  loom_lock_release(ring->reaping);
+
+  return reaped;
+}
+
+void loom_io_ring_wait(loom_io_ring_t *ring) {
+  // Submit anything left behind by a failed submission, or we could wait on
+  // it forever. The kernel only consumes what's been published, so we don't
+  // need to hold the lock.
+  const unsigned pending = loom_atomic_load_u32((const volatile loom_uint32_t *)ring->sq_tail)
+                         - loom_atomic_load_u32((const volatile loom_uint32_t *)ring->sq_head);
+
+  loom_io_uring_enter(ring->fd, pending, 1, IORING_ENTER_GETEVENTS);
+}
+
+#endif
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+
+// Maps the errors we're likely to see to their closest `errno`.
+static int loom_io_errno_of(DWORD error) {
+  switch (error) {
+    case ERROR_INVALID_HANDLE:
+      return EBADF;
+
+    case ERROR_ACCESS_DENIED:
+      return EACCES;
+
+    case ERROR_INVALID_PARAMETER:
+      return EINVAL;
+
+    case ERROR_NOT_ENOUGH_MEMORY:
+    case ERROR_OUTOFMEMORY:
+      return ENOMEM;
+
+    case ERROR_DISK_FULL:
+    case ERROR_HANDLE_DISK_FULL:
+      return ENOSPC;
+  }
+
+  return EIO;
+}
+
+#endif
+
+loom_int64_t loom_io_perform(loom_uint32_t op,
+                             loom_int32_t fd,
+                             void *buffer,
+                             loom_size_t size,
+                             loom_uint64_t offset) {
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  const HANDLE handle = (HANDLE)_get_osfhandle(fd);
+
+  if (handle == INVALID_HANDLE_VALUE)
+    return -(loom_int64_t)EBADF;
+
+  // Specifying an offset through an `OVERLAPPED` makes reads and writes
+  // positional, even for synchronous handles, like `pread` and `pwrite`.
+  OVERLAPPED overlapped;
+  memset((void *)&overlapped, 0, sizeof(overlapped));
+  overlapped.Offset = (DWORD)(offset & 0xffffffffull);
+  overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+  // Transfers are capped, so large ones may be short, as with `pread`.
+  const DWORD requested = (size > 0xffffffffull) ? 0xffffffff : (DWORD)size;
+
+  DWORD transferred = 0;
+  BOOL succeeded = TRUE;
+
+  switch (op) {
+    case LOOM_IO_RING_READ:
+      succeeded = ReadFile(handle, buffer, requested, &transferred, &overlapped);
+      break;
+
+    case LOOM_IO_RING_WRITE:
+      succeeded = WriteFile(handle, (LPCVOID)buffer, requested, &transferred, &overlapped);
+      break;
+
+    case LOOM_IO_RING_FSYNC:
+      succeeded = FlushFileBuffers(handle);
+      break;
+
+    case LOOM_IO_RING_NOP:
+      break;
+  }
+
+  if (!succeeded) {
+    const DWORD error = GetLastError();
+
+    if (error == ERROR_HANDLE_EOF)
+      // Reading at or past the end of a file isn't an error.
+      return 0;
+
+    return -(loom_int64_t)loom_io_errno_of(error);
+  }
+
+  return (loom_int64_t)transferred;
+#else
+  loom_int64_t result = -1;
+
+  switch (op) {
+    case LOOM_IO_RING_READ:
+      result = pread(fd, buffer, size, (off_t)offset);
+      break;
+
+    case LOOM_IO_RING_WRITE:
+      result = pwrite(fd, (const void *)buffer, size, (off_t)offset);
+      break;
+
+    case LOOM_IO_RING_FSYNC:
+      result = fsync(fd);
+      break;
+
+    case LOOM_IO_RING_NOP:
+      result = 0;
+      break;
+  }
+
+  return (result < 0) ? -(loom_int64_t)errno : result;
+#endif
+}
+
+LOOM_END_EXTERN_C
@@ -15,6 +15,9 @@
 
 #if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
   #include <windows.h>
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
+      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  #include <pthread.h>
 #endif
 
 LOOM_BEGIN_EXTERN_C
@@ -24,6 +27,7 @@ struct loom_lock {
   CRITICAL_SECTION cs;
 #elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
       LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  pthread_mutex_t mutex;
 #endif
 };
 
@@ -35,6 +39,7 @@ loom_lock_t *loom_lock_create(void) {
   InitializeCriticalSection(&lock->cs);
 #elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
       LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  pthread_mutex_init(&lock->mutex, NULL);
 #endif
 
   return lock;
@@ -47,6 +52,7 @@ void loom_lock_destroy(loom_lock_t *lock) {
   DeleteCriticalSection(&lock->cs);
 #elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
       LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  pthread_mutex_destroy(&lock->mutex);
 #endif
 
   free((void *)lock);
@@ -59,6 +65,7 @@ void loom_lock_acquire(loom_lock_t *lock) {
   EnterCriticalSection(&lock->cs);
 #elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
       LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  pthread_mutex_lock(&lock->mutex);
 #endif
 }
 
@@ -69,6 +76,7 @@ void loom_lock_release(loom_lock_t *lock) {
   LeaveCriticalSection(&lock->cs);
 #elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
       LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  pthread_mutex_unlock(&lock->mutex);
 #endif
 }
 
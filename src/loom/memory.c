@@ -0,0 +1,226 @@
+//===-- loom/memory.c -----------------------------------*- mode: C++11 -*-===//
+//
+//                            __                  
+//                           |  |   ___ ___ _____ 
+//                           |  |__| . | . |     |
+//                           |_____|___|___|_|_|_|
+//
+//       This file is distributed under the terms described in LICENSE.
+//
+//===----------------------------------------------------------------------===//
+
+#include "loom/memory.h"
+
+#include "loom/support.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  #include <malloc.h>
+  #include <windows.h>
+#endif
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
+    LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  #include <stdio.h>
+  #include <unistd.h>
+  #include <dirent.h>
+  #include <sys/mman.h>
+#endif
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // We call `mbind` directly rather than depend on `libnuma`.
+  #include <sys/syscall.h>
+#endif
+
+LOOM_BEGIN_EXTERN_C
+
+void *loom_memory_alloc(loom_size_t size,
+                        loom_size_t alignment) {
+  // Must be a power of two and a multiple of pointer size.
+  loom_assert_debug((alignment & (alignment - 1)) == 0);
+  loom_assert_debug((alignment % sizeof(void *)) == 0);
+
+  void *memory = NULL;
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  memory = _aligned_malloc(size, alignment);
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
+      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  if (posix_memalign(&memory, alignment, size) != 0)
+    memory = NULL;
+#endif
+
+  loom_assert_debug(memory != NULL);
+
+  memset(memory, 0, size);
+
+  return memory;
+}
+
+void loom_memory_free(void *memory) {
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  _aligned_free(memory);
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
+      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  free(memory);
+#endif
+}
+
+// We assume the common huge page size, as it's the only one we can rely on
+// being available without configuration.
+#define LOOM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Rounds @size up to the granularity we'll map it with.
+static loom_size_t loom_memory_mapped_size(loom_size_t size,
+                                           loom_uint32_t flags) {
+  const loom_size_t granularity =
+    ((flags & (LOOM_MEMORY_TRANSPARENT_HUGE_PAGES | LOOM_MEMORY_HUGE_PAGES))
+      && (size >= LOOM_HUGE_PAGE_SIZE)) ? LOOM_HUGE_PAGE_SIZE : 4096;
+
+  return (size + granularity - 1) & ~(granularity - 1);
+}
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // From `linux/mempolicy.h`.
+  #define LOOM_MPOL_PREFERRED 1
+
+  static void loom_memory_bind(void *memory,
+                               loom_size_t size,
+                               loom_int32_t node) {
+    // Only as many nodes as bits in a mask are supported.
+    if ((node < 0) || (node >= (loom_int32_t)(8 * sizeof(unsigned long))))
+      return;
+
+    const unsigned long mask = 1ul << node;
+
+    // Preferred rather than bound, so we fall back to other nodes rather than
+    // fail when a node runs out of memory.
+    syscall(SYS_mbind, memory, size, LOOM_MPOL_PREFERRED, &mask, 8 * sizeof(mask) + 1, 0);
+  }
+#endif
+
+void *loom_memory_map(loom_size_t size,
+                      loom_uint32_t flags,
+                      loom_int32_t node) {
+  const loom_size_t mapped = loom_memory_mapped_size(size, flags);
+
+  // Only back with huge pages when asked to, even if a whole number of them.
+  const loom_bool_t huge =
+    (flags & (LOOM_MEMORY_TRANSPARENT_HUGE_PAGES | LOOM_MEMORY_HUGE_PAGES))
+      && ((mapped % LOOM_HUGE_PAGE_SIZE) == 0);
+
+  void *memory = NULL;
+
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  const DWORD type = MEM_RESERVE | MEM_COMMIT;
+
+  if (huge && (flags & LOOM_MEMORY_HUGE_PAGES) && (GetLargePageMinimum() == LOOM_HUGE_PAGE_SIZE))
+    // Requires `SeLockMemoryPrivilege`, so may well fail.
+    memory = (node == LOOM_MEMORY_ANY_NODE)
+           ? VirtualAlloc(NULL, mapped, type | MEM_LARGE_PAGES, PAGE_READWRITE)
+           : VirtualAllocExNuma(GetCurrentProcess(), NULL, mapped, type | MEM_LARGE_PAGES, PAGE_READWRITE, node);
+
+  if (memory == NULL)
+    memory = (node == LOOM_MEMORY_ANY_NODE)
+           ? VirtualAlloc(NULL, mapped, type, PAGE_READWRITE)
+           : VirtualAllocExNuma(GetCurrentProcess(), NULL, mapped, type, PAGE_READWRITE, node);
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC
+  (void)node;
+
+  memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+  if (memory == MAP_FAILED)
+    memory = NULL;
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  if (huge && (flags & LOOM_MEMORY_HUGE_PAGES)) {
+    memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (memory == MAP_FAILED)
+      // No huge pages reserved.
+      memory = NULL;
+  }
+
+  if (memory == NULL && huge) {
+    // Over-allocate so we can align to a huge page boundary, as otherwise
+    // the kernel can't back us with huge pages.
+    loom_uint8_t *unaligned =
+      (loom_uint8_t *)mmap(NULL, mapped + LOOM_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (unaligned != (loom_uint8_t *)MAP_FAILED) {
+      loom_uint8_t *aligned =
+        (loom_uint8_t *)(((loom_native_t)unaligned + LOOM_HUGE_PAGE_SIZE - 1) & ~((loom_native_t)LOOM_HUGE_PAGE_SIZE - 1));
+
+      if (aligned != unaligned)
+        munmap((void *)unaligned, aligned - unaligned);
+
+      munmap((void *)(aligned + mapped), (unaligned + LOOM_HUGE_PAGE_SIZE) - aligned);
+
+      madvise((void *)aligned, mapped, MADV_HUGEPAGE);
+
+      memory = (void *)aligned;
+    }
+  }
+
+  if (memory == NULL) {
+    memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED)
+      memory = NULL;
+  }
+
+  if (memory && (node != LOOM_MEMORY_ANY_NODE))
+    // Pages aren't faulted in until touched, so binding now is sufficient.
+    loom_memory_bind(memory, mapped, node);
+#endif
+
+  loom_assert_debug(memory != NULL);
+
+  return memory;
+}
+
+void loom_memory_unmap(void *memory,
+                       loom_size_t size,
+                       loom_uint32_t flags) {
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  (void)size;
+  (void)flags;
+
+  VirtualFree(memory, 0, MEM_RELEASE);
+#elif LOOM_PLATFORM == LOOM_PLATFORM_MAC || \
+      LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  munmap(memory, loom_memory_mapped_size(size, flags));
+#endif
+}
+
+loom_int32_t loom_memory_node_of_core(unsigned core) {
+#if LOOM_PLATFORM == LOOM_PLATFORM_WINDOWS
+  UCHAR node;
+
+  if (GetNumaProcessorNode((UCHAR)core, &node) && (node != 0xff))
+    return node;
+#elif LOOM_PLATFORM == LOOM_PLATFORM_LINUX
+  // Each core links to its node, as `nodeN`, in sysfs.
+  char path[64];
+  snprintf(&path[0], sizeof(path), "/sys/devices/system/cpu/cpu%u", core);
+
+  if (DIR *directory = opendir(&path[0])) {
+    loom_int32_t node = LOOM_MEMORY_ANY_NODE;
+
+    while (struct dirent *entry = readdir(directory))
+      if (sscanf(entry->d_name, "node%d", &node) == 1)
+        break;
+
+    closedir(directory);
+
+    return node;
+  }
+#else
+  (void)core;
+#endif
+
+  return LOOM_MEMORY_ANY_NODE;
+}
+
+LOOM_END_EXTERN_C